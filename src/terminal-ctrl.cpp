@@ -24,106 +24,1711 @@
 #include <wx/dcbuffer.h>
 #include <wx/caret.h>
 #include <wx/event.h>
+#include <wx/mstream.h>
+#include <wx/zstream.h>
+#include <wx/filename.h>
+#include <wx/file.h>
+#include <wx/wfstream.h>
 
 #include <cstring>
 #include <cstdarg>
+#include <cstddef>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __UNIX__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
-#include "terminal-ctrl.hpp"
-#include "terminal-connector.hpp"
+#include "terminal-ctrl.hpp"
+#include "terminal-connector.hpp"
+
+//
+//
+// Debug features:
+//
+//
+#if 1 // Debuging feature activated
+
+#define DBGOUT (std::cout)
+#define NOT_IMPLEMENTED(content) {DBGOUT << "Not implemented: " << content << std::endl;}
+
+#else  // Debuging feature activated
+
+#define NOT_IMPLEMENTED(content);
+
+#endif // Debuging feature activated
+
+
+
+#if 0 // Tracing  feature activated
+
+#define TRACEOUT (std::cout)
+#define TRACE(content) {TRACEOUT << content << std::endl;}
+
+#else // Tracing  feature activated
+
+#define TRACE(content);
+
+#endif  // Tracing  feature activated
+
+
+//
+//
+// Predefined char sequences
+//
+//
+
+#define _ESC "\x1B"
+#define _CSI _ESC "["
+#define _SS3 _ESC "O"
+
+
+//
+//
+// wxTerminalCharacter
+//
+//
+
+wxTerminalCharacter wxTerminalCharacter::DefaultCharacter = { 0, wxTerminalAttributeTable::DEFAULT_INDEX };
+
+/**
+ * Fill cells with a character.
+ * With SSE2, characters are 8 bytes and 4 of them are stored with two 16-byte stores.
+ */
+static void FillCells(wxTerminalCharacter* cells, size_t count, wxTerminalCharacter ch)
+{
+#if defined(__SSE2__)
+	if(sizeof(wxTerminalCharacter)==8)
+	{
+		// Padding bytes are cleared so that the pattern is fully defined.
+		wxTerminalCharacter cell;
+		memset((void*)&cell, 0, sizeof(cell));
+		cell.c = ch.c;
+		cell.attr = ch.attr;
+		long long bits;
+		memcpy(&bits, (const void*)&cell, sizeof(bits));
+		const __m128i pattern = _mm_set1_epi64x(bits);
+		for(; count>=4; count-=4, cells+=4)
+		{
+			_mm_storeu_si128((__m128i*)cells, pattern);
+			_mm_storeu_si128((__m128i*)(cells + 2), pattern);
+		}
+	}
+#endif
+	std::fill(cells, cells + count, ch);
+}
+
+/**
+ * Replace the attribute index of cells, from the first one up to the first one with another index.
+ * With SSE2, the attribute indexes of 2 characters are compared and replaced at once,
+ * other fields are left untouched.
+ * \return Number of replaced cells.
+ */
+static size_t ReplaceAttribute(wxTerminalCharacter* cells, size_t count, unsigned short from, unsigned short to)
+{
+	size_t n = 0;
+#if defined(__SSE2__)
+	if(sizeof(wxTerminalCharacter)==8 && offsetof(wxTerminalCharacter, attr)==4)
+	{
+		// Attribute indexes are the 16-bit lanes 2 and 6 of a pair of characters, bytes 4-5 and 12-13.
+		const __m128i mask = _mm_set_epi16(0, -1, 0, 0, 0, -1, 0, 0);
+		const __m128i fromPattern = _mm_set1_epi16((short)from);
+		const __m128i toPattern = _mm_and_si128(_mm_set1_epi16((short)to), mask);
+		for(; n+2<=count; n+=2)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(cells + n));
+			if((_mm_movemask_epi8(_mm_cmpeq_epi16(v, fromPattern)) & 0x3030) != 0x3030)
+				break;
+			_mm_storeu_si128((__m128i*)(cells + n), _mm_or_si128(_mm_andnot_si128(mask, v), toPattern));
+		}
+	}
+#endif
+	for(; n<count && cells[n].attr==from; ++n)
+		cells[n].attr = to;
+	return n;
+}
+
+//
+//
+// wxTerminalFrozenLine
+//
+//
+
+template<typename T>
+static void FreezeText(const wxTerminalLine& line, void* data)
+{
+	T* text = (T*)data;
+	for(size_t col=0; col<line.size(); ++col)
+		text[col] = line[col].c.GetValue();
+}
+
+template<typename T>
+static void ThawText(const void* data, wxTerminalLine& line)
+{
+	const T* text = (const T*)data;
+	for(size_t col=0; col<line.size(); ++col)
+		line[col].c = text[col];
+}
+
+wxTerminalFrozenLine::wxTerminalFrozenLine(const wxTerminalFrozenLine& line):
+_data(NULL),
+_runCount(line._runCount),
+_shift(line._shift),
+_length(line._length),
+_wrapped(line._wrapped)
+{
+	if(line._data)
+	{
+		_data = new unsigned int[getDataSize()];
+		std::copy(line._data, line._data + getDataSize(), _data);
+	}
+}
+
+wxTerminalFrozenLine::wxTerminalFrozenLine(wxTerminalFrozenLine&& line) noexcept:
+_data(line._data),
+_runCount(line._runCount),
+_shift(line._shift),
+_length(line._length),
+_wrapped(line._wrapped)
+{
+	line._data = NULL;
+	line._runCount = 0;
+	line._shift = 0;
+	line._length = 0;
+	line._wrapped = 0;
+}
+
+void wxTerminalFrozenLine::swap(wxTerminalFrozenLine& line) noexcept
+{
+	std::swap(_data, line._data);
+	unsigned int runs = _runCount, shift = _shift, length = _length, wrapped = _wrapped;
+	_runCount = line._runCount;
+	_shift = line._shift;
+	_length = line._length;
+	_wrapped = line._wrapped;
+	line._runCount = runs;
+	line._shift = shift;
+	line._length = length;
+	line._wrapped = wrapped;
+}
+
+void wxTerminalFrozenLine::freeze(const wxTerminalLine& line)
+{
+	if(line.empty())
+	{
+		clear();
+		return;
+	}
+
+	// Count runs and find the code point size first to allocate the exact size.
+	unsigned int runs = 0, bits = 0;
+	for(size_t col=0, len=0; col<line.size(); ++col, ++len)
+	{
+		if(col==0 || line[col].attr!=line[col-1].attr || len==MAX_RUN_LENGTH)
+		{
+			++runs;
+			len = 0;
+		}
+		bits |= line[col].c.GetValue();
+	}
+	unsigned int shift = bits<0x100 ? 0 : bits<0x10000 ? 1 : 2;
+
+	clear();
+	_runCount = runs;
+	_shift = shift;
+	_length = line.size();
+	_data = new unsigned int[getDataSize()];
+
+	unsigned int* run = _data - 1;
+	for(size_t col=0; col<line.size(); ++col)
+	{
+		if(col==0 || line[col].attr!=line[col-1].attr || (*run & MAX_RUN_LENGTH)==MAX_RUN_LENGTH)
+			*++run = line[col].attr << 16;
+		++*run;
+	}
+	// Clear padding bytes of the last word, they are compressed with the line.
+	_data[getDataSize()-1] = 0;
+	switch(shift)
+	{
+	case 0: FreezeText<unsigned char>(line, _data + runs); break;
+	case 1: FreezeText<unsigned short>(line, _data + runs); break;
+	default: FreezeText<unsigned int>(line, _data + runs); break;
+	}
+}
+
+void wxTerminalFrozenLine::thaw(wxTerminalLine& line)const
+{
+	line.resize(_length);
+	if(_length==0)
+		return;
+
+	switch(_shift)
+	{
+	case 0: ThawText<unsigned char>(_data + _runCount, line); break;
+	case 1: ThawText<unsigned short>(_data + _runCount, line); break;
+	default: ThawText<unsigned int>(_data + _runCount, line); break;
+	}
+
+	size_t col = 0;
+	for(unsigned int n=0; n<_runCount; ++n)
+	{
+		unsigned short attr = _data[n] >> 16;
+		for(size_t end = col + (_data[n] & MAX_RUN_LENGTH); col<end; ++col)
+			line[col].attr = attr;
+	}
+}
+
+void wxTerminalFrozenLine::save(std::vector<unsigned int>& buffer)const
+{
+	buffer.push_back(_length | (_wrapped << 31));
+	if(_length==0)
+		return;
+	buffer.push_back(_runCount | (_shift << 30));
+	buffer.insert(buffer.end(), _data, _data + getDataSize());
+}
+
+const unsigned int* wxTerminalFrozenLine::load(const unsigned int* buffer)
+{
+	unsigned int length = *buffer & 0x7FFFFFFF;
+	_wrapped = *buffer++ >> 31;
+	if(length==0)
+	{
+		clear();
+		return buffer;
+	}
+	unsigned int header = *buffer++;
+	clear();
+	_length = length;
+	_runCount = header & 0x3FFFFFFF;
+	_shift = header >> 30;
+	_data = new unsigned int[getDataSize()];
+	std::copy(buffer, buffer + getDataSize(), _data);
+	return buffer + getDataSize();
+}
+
+const unsigned int* wxTerminalFrozenLine::load(const unsigned int* buffer, const unsigned int* end)
+{
+	if(buffer >= end)
+		return NULL;
+	size_t length = buffer[0] & 0x7FFFFFFF;
+	if(length==0)
+		return load(buffer);
+	if(end - buffer < 2)
+		return NULL;
+	size_t runs = buffer[1] & 0x3FFFFFFF, shift = buffer[1] >> 30;
+	if(shift > 2)
+		return NULL;
+	size_t size = runs + ((length << shift) + 3) / 4;
+	if((size_t)(end - buffer - 2) < size)
+		return NULL;
+	// Thawing relies on the runs covering the line exactly.
+	size_t covered = 0;
+	for(size_t n=0; n<runs; ++n)
+		covered += buffer[2 + n] & MAX_RUN_LENGTH;
+	if(covered!=length)
+		return NULL;
+	return load(buffer);
+}
+
+//
+//
+// wxTerminalSpillFile
+//
+//
+
+wxTerminalSpillFile::wxTerminalSpillFile():
+_firstBlock(0),
+_writePos(0),
+_maxBytes(0),
+_fd(-1),
+_map(NULL)
+{
+}
+
+wxTerminalSpillFile::~wxTerminalSpillFile()
+{
+	close();
+}
+
+bool wxTerminalSpillFile::open(const wxString& path, size_t maxBytes)
+{
+	close();
+#ifdef __UNIX__
+	_path = path.empty() ? wxFileName::CreateTempFileName("wxterminal") : path;
+	if(_path.empty() || maxBytes==0)
+		return false;
+
+	// The file is sized once, its pages are only allocated on disk when written.
+	_fd = ::open(_path.fn_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if(_fd<0)
+		return false;
+	if(::ftruncate(_fd, maxBytes)==0)
+	{
+		void* map = ::mmap(NULL, maxBytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+		if(map!=MAP_FAILED)
+			_map = (unsigned char*)map;
+	}
+	if(_map==NULL)
+	{
+		::close(_fd);
+		_fd = -1;
+		wxRemoveFile(_path);
+		return false;
+	}
+
+	_maxBytes = maxBytes;
+	clear();
+	return true;
+#else
+	return false;
+#endif
+}
+
+void wxTerminalSpillFile::close()
+{
+#ifdef __UNIX__
+	if(_map!=NULL)
+	{
+		::munmap(_map, _maxBytes);
+		_map = NULL;
+	}
+	if(_fd>=0)
+	{
+		::close(_fd);
+		_fd = -1;
+		wxRemoveFile(_path);
+	}
+#endif
+	clear();
+}
+
+void wxTerminalSpillFile::append(size_t block, const unsigned char* data, size_t size, size_t words)
+{
+	if(_map==NULL || size>_maxBytes || block<getEndBlock())
+		return;
+
+	// Blocks not given in between are not stored.
+	if(_index.empty())
+		_firstBlock = block;
+	while(getEndBlock() < block)
+	{
+		Entry skipped = {_writePos, 0, 0};
+		_index.push_back(skipped);
+	}
+
+	// Wrap at the end of the file, the blocks after the write position are the oldest ones
+	// and are dropped first, the next oldest ones are then at the start of the file.
+	if(_writePos + size > _maxBytes)
+	{
+		while(!_index.empty() && (_index.front().size==0 || _index.front().offset >= _writePos))
+		{
+			_index.pop_front();
+			++_firstBlock;
+		}
+		_writePos = 0;
+	}
+	// Drop the oldest blocks overlapping the written range.
+	while(!_index.empty() && (_index.front().size==0 || _index.front().offset < _writePos + size))
+	{
+		if(_index.front().size!=0 && _index.front().offset + _index.front().size <= _writePos)
+			break;
+		_index.pop_front();
+		++_firstBlock;
+	}
+	if(_index.empty())
+		_firstBlock = block;
+
+	memcpy(_map + _writePos, data, size);
+	Entry entry = {_writePos, size, words};
+	_index.push_back(entry);
+	_writePos += size;
+}
+
+const unsigned char* wxTerminalSpillFile::get(size_t block, size_t& size, size_t& words)const
+{
+	if(block<_firstBlock || block>=getEndBlock())
+		return NULL;
+	const Entry& entry = _index[block - _firstBlock];
+	if(entry.size==0)
+		return NULL;
+	size = entry.size;
+	words = entry.words;
+	return _map + entry.offset;
+}
+
+void wxTerminalSpillFile::clear()
+{
+	_index.clear();
+	_firstBlock = 0;
+	_writePos = 0;
+}
+
+size_t wxTerminalSpillFile::getBlockCount()const
+{
+	size_t count = 0;
+	for(size_t n=0; n<_index.size(); ++n)
+		if(_index[n].size!=0)
+			++count;
+	return count;
+}
+
+size_t wxTerminalSpillFile::getUsedBytes()const
+{
+	size_t bytes = 0;
+	for(size_t n=0; n<_index.size(); ++n)
+		bytes += _index[n].size;
+	return bytes;
+}
+
+//
+//
+// wxTerminalSessionWriter / wxTerminalSessionReader
+//
+//
+
+void wxTerminalSessionWriter::write(const void* data, size_t size)
+{
+	if(size==0)
+		return;
+	_out.Write(data, size);
+	if(_out.LastWrite()!=size)
+		_ok = false;
+	_position += size;
+}
+
+void wxTerminalSessionWriter::write(const wxString& str)
+{
+	wxScopedCharBuffer utf8 = str.utf8_str();
+	write<wxUint32>(utf8.length());
+	write(utf8.data(), utf8.length());
+}
+
+void wxTerminalSessionWriter::write(const wxTerminalCharacterAttributes& attr)
+{
+	write<wxUint32>(attr.fore);
+	write<wxUint32>(attr.back);
+	write<wxUint8>(attr.style);
+	write<wxUint8>(attr.underline);
+	write<wxUint16>(attr.hyperlink);
+}
+
+void wxTerminalSessionWriter::align()
+{
+	static const unsigned char padding[4] = {0, 0, 0, 0};
+	write(padding, (4 - _position % 4) % 4);
+}
+
+bool wxTerminalSessionReader::read(void* data, size_t size)
+{
+	const unsigned char* src = skip(size);
+	if(src==NULL)
+		return false;
+	memcpy(data, src, size);
+	return true;
+}
+
+bool wxTerminalSessionReader::read(wxString& str)
+{
+	wxUint32 length;
+	const unsigned char* utf8;
+	if(!read(length) || (utf8 = skip(length))==NULL)
+		return false;
+	str = wxString::FromUTF8((const char*)utf8, length);
+	return true;
+}
+
+bool wxTerminalSessionReader::read(wxTerminalCharacterAttributes& attr)
+{
+	wxUint32 fore, back;
+	wxUint8 style, underline;
+	wxUint16 hyperlink;
+	if(!read(fore) || !read(back) || !read(style) || !read(underline) || !read(hyperlink))
+		return false;
+	attr.fore = fore;
+	attr.back = back;
+	attr.style = style;
+	attr.underline = underline;
+	attr.hyperlink = hyperlink;
+	return true;
+}
+
+const unsigned char* wxTerminalSessionReader::skip(size_t size)
+{
+	if(getRemaining() < size)
+		return NULL;
+	const unsigned char* data = _data;
+	_data += size;
+	return data;
+}
+
+bool wxTerminalSessionReader::align()
+{
+	return skip((4 - (_data - _begin) % 4) % 4)!=NULL;
+}
+
+//
+//
+// wxTerminalContent
+//
+//
+
+const wxTerminalLine wxTerminalContent::BlankLine;
+
+wxTerminalContent::wxTerminalContent(size_t maxLines):
+_start(0),
+_first(0),
+_count(0),
+_max(maxLines>0 ? maxLines : 1),
+_active(25),
+_width(80),
+_reflowed(0),
+_hot(DEFAULT_HOT_LINES),
+_compressionLevel(DEFAULT_COMPRESSION_LEVEL),
+_firstBlock(0),
+_spill(NULL)
+{
+}
+
+wxTerminalContent::~wxTerminalContent()
+{
+	delete _spill;
+}
+
+void wxTerminalContent::setChar(wxPoint pos, wxTerminalCharacter c)
+{
+	getChar(pos.y, pos.x) = c;
+}
+
+void wxTerminalContent::insertChar(wxPoint pos, wxTerminalCharacter c)
+{
+	getChar(pos.y, pos.x);
+	wxTerminalLine& line = getLine(pos.y);
+	if(pos.y + _active >= getEndLine() && line.size() >= _width)
+	{
+		// Fixed width row: shift in place, the last character is lost.
+		std::copy_backward(line.begin()+pos.x, line.end()-1, line.end());
+		line[pos.x] = c;
+	}
+	else
+		line.insert(line.begin()+pos.x, c);
+}
+
+void wxTerminalContent::addNewLine()
+{
+	if(_count < _lines.size())
+	{
+		// Reuse a slot released by deleteLines.
+		_lines[slot(_first + _count)].clear();
+		++_count;
+	}
+	else if(_lines.size() < _max)
+	{
+		// Not full yet, the ring has never wrapped so _start is 0.
+		// Grow up to the maximum size, not beyond.
+		if(_lines.size() == _lines.capacity())
+			_lines.reserve(std::min(_max, std::max<size_t>(64, _lines.capacity() * 2)));
+		_lines.push_back(Slot());
+		++_count;
+	}
+	else
+	{
+		// Full: a block starting to be recycled is kept compressed for the spill file.
+		if(_spill!=NULL && _first % BLOCK_LINES == 0)
+			compress(_first / BLOCK_LINES, _compressionLevel);
+
+		// Recycle the oldest line (keeping its capacity).
+		_lines[_start].clear();
+		if(++_start == _lines.size())
+			_start = 0;
+		++_first;
+		dropBlocks();
+	}
+
+	// The line leaving the active area is now history.
+	if(_count > _active)
+		freeze(getEndLine() - _active - 1);
+
+	// The block leaving the hot window is now cold.
+	size_t hot = std::max(_hot, _active);
+	if(_compressionLevel>0 && getEndLine()>hot && (getEndLine()-hot) % BLOCK_LINES == 0)
+		compress((getEndLine()-hot) / BLOCK_LINES - 1, _compressionLevel);
+}
+
+void wxTerminalContent::freeze(size_t line)
+{
+	if(line < _first || line >= getEndLine())
+		return;
+	Slot& s = _lines[slot(line)];
+	if(s.line.empty())
+		return;
+
+	// Blanks filling the row up to the screen width are not kept,
+	// they are part of the text if it continues on the next row.
+	size_t size = s.line.size();
+	while(!s.frozen.isWrapped() && size>0 && s.line[size-1].c==wxTerminalCharacter::DefaultCharacter.c && s.line[size-1].attr==wxTerminalCharacter::DefaultCharacter.attr)
+		--size;
+	s.line.resize(size);
+	s.frozen.freeze(s.line);
+
+	// Keep the characters for the next row instead of releasing them.
+	s.line.clear();
+	s.line.swap(_spare);
+	wxTerminalLine().swap(s.line);
+}
+
+void wxTerminalContent::addStatistics(wxTerminalMemoryStatistics& stats)const
+{
+	stats.lines += _count;
+	stats.bytes += _lines.capacity() * sizeof(Slot);
+	for(size_t n=0; n<_lines.size(); ++n)
+	{
+		const Slot& s = _lines[n];
+		stats.bytes += s.line.capacity() * sizeof(wxTerminalCharacter) + s.frozen.getMemorySize();
+	}
+	for(size_t n=0; n<_blocks.size(); ++n)
+		stats.bytes += _blocks[n].data.capacity();
+	if(_spill!=NULL)
+	{
+		stats.spilledLines += _spill->getBlockCount() * BLOCK_LINES;
+		stats.spillBytes += _spill->getUsedBytes();
+	}
+	for(std::list<CachedBlock>::const_iterator it=_cache.begin(); it!=_cache.end(); ++it)
+	{
+		for(size_t n=0; n<it->lines.size(); ++n)
+			stats.bytes += it->lines[n].getMemorySize();
+	}
+	for(size_t n=_first; n<getEndLine(); ++n)
+	{
+		const wxTerminalFrozenLine& frozen = _lines[slot(n)].frozen;
+		if(getBlock(n)!=NULL)
+			++stats.compressedLines;
+		else if(frozen.empty())
+			++stats.cellLines;
+		else if(frozen.getWidth()==1)
+			++stats.frozen8Lines;
+		else if(frozen.getWidth()==2)
+			++stats.frozen16Lines;
+		else
+			++stats.frozen32Lines;
+	}
+}
+
+const wxTerminalContent::Block* wxTerminalContent::getBlock(size_t line)const
+{
+	size_t block = line / BLOCK_LINES;
+	if(block < _firstBlock || block >= _firstBlock + _blocks.size())
+		return NULL;
+	const Block& b = _blocks[block - _firstBlock];
+	return b.data.empty() ? NULL : &b;
+}
+
+void wxTerminalContent::compress(size_t block, int level)
+{
+#if wxUSE_ZLIB
+	// Blocks partially dropped are not worth it.
+	size_t begin = block * BLOCK_LINES, end = begin + BLOCK_LINES;
+	if(begin < _first || end > getEndLine() || getBlock(begin)!=NULL)
+		return;
+
+	std::vector<unsigned int> buffer;
+	for(size_t n=begin; n<end; ++n)
+	{
+		freeze(n);
+		_lines[slot(n)].frozen.save(buffer);
+	}
+
+	wxMemoryOutputStream mem;
+	{
+		wxZlibOutputStream zlib(mem, level, wxZLIB_NO_HEADER);
+		zlib.Write(&buffer[0], buffer.size() * sizeof(unsigned int));
+		zlib.Close();
+	}
+
+	if(_blocks.empty())
+		_firstBlock = block;
+	while(_firstBlock + _blocks.size() <= block)
+		_blocks.push_back(Block());
+	Block& b = _blocks[block - _firstBlock];
+	b.data.resize(mem.GetSize());
+	mem.CopyTo(&b.data[0], b.data.size());
+	b.size = buffer.size();
+
+	for(size_t n=begin; n<end; ++n)
+		_lines[slot(n)].clear();
+#endif
+}
+
+const unsigned char* wxTerminalContent::getBlockData(size_t block, size_t& size, size_t& words)const
+{
+	if(block >= _firstBlock && block < _firstBlock + _blocks.size())
+	{
+		const Block& b = _blocks[block - _firstBlock];
+		if(b.data.empty())
+			return NULL;
+		size = b.data.size();
+		words = b.size;
+		return &b.data[0];
+	}
+	return _spill!=NULL ? _spill->get(block, size, words) : NULL;
+}
+
+const std::vector<wxTerminalFrozenLine>& wxTerminalContent::uncompress(size_t block)const
+{
+	for(std::list<CachedBlock>::iterator it=_cache.begin(); it!=_cache.end(); ++it)
+	{
+		if(it->index==block)
+		{
+			_cache.splice(_cache.begin(), _cache, it);
+			return it->lines;
+		}
+	}
+
+	if(_cache.size() >= CACHED_BLOCKS)
+		_cache.pop_back();
+	_cache.push_front(CachedBlock());
+	CachedBlock& cached = _cache.front();
+	cached.index = block;
+	cached.lines.resize(BLOCK_LINES);
+
+#if wxUSE_ZLIB
+	// Lines of a block not stored anymore are left blank.
+	size_t size, words;
+	const unsigned char* compressed = getBlockData(block, size, words);
+	if(compressed==NULL || words==0)
+		return cached.lines;
+	std::vector<unsigned int> buffer(words);
+	wxMemoryInputStream mem(compressed, size);
+	wxZlibInputStream zlib(mem, wxZLIB_NO_HEADER);
+	zlib.Read(&buffer[0], buffer.size() * sizeof(unsigned int));
+	if(zlib.LastRead() != buffer.size() * sizeof(unsigned int))
+		return cached.lines;
+
+	// Blocks may come from a session file, do not trust their content.
+	const unsigned int* data = &buffer[0];
+	for(size_t n=0; n<BLOCK_LINES && data!=NULL; ++n)
+		data = cached.lines[n].load(data, &buffer[0] + buffer.size());
+#endif
+	return cached.lines;
+}
+
+void wxTerminalContent::expand(size_t block)
+{
+	const std::vector<wxTerminalFrozenLine>& lines = uncompress(block);
+	size_t begin = block * BLOCK_LINES;
+	for(size_t n=std::max(begin, _first); n<begin+BLOCK_LINES && n<getEndLine(); ++n)
+		_lines[slot(n)].frozen = lines[n - begin];
+
+	std::vector<unsigned char>().swap(_blocks[block - _firstBlock].data);
+	_cache.pop_front();
+}
+
+void wxTerminalContent::expandFrom(size_t line)
+{
+	for(size_t block=std::max(line / BLOCK_LINES, _firstBlock); block<_firstBlock+_blocks.size(); ++block)
+	{
+		if(!_blocks[block - _firstBlock].data.empty())
+			expand(block);
+	}
+}
+
+void wxTerminalContent::dropBlocks()
+{
+	while(!_blocks.empty() && (_firstBlock+1) * BLOCK_LINES <= _first)
+	{
+		const Block& b = _blocks.front();
+		if(_spill!=NULL && !b.data.empty())
+			_spill->append(_firstBlock, &b.data[0], b.data.size(), b.size);
+		_blocks.pop_front();
+		++_firstBlock;
+	}
+}
+
+wxTerminalLine& wxTerminalContent::thaw(size_t line)
+{
+	if(getBlock(line)!=NULL)
+		expand(line / BLOCK_LINES);
+
+	Slot& s = _lines[slot(line)];
+	if(!s.frozen.empty())
+	{
+		s.frozen.thaw(s.line);
+		s.frozen.clear();
+	}
+	return s.line;
+}
+
+wxTerminalLine& wxTerminalContent::getLine(size_t line)
+{
+	if(line < _first)
+		return (*this)[line];
+
+	// Ensure has line, create it if not.
+	while(getEndLine() <= line)
+		addNewLine();
+
+	// Rows of the active area have a fixed width, characters are then written in place.
+	wxTerminalLine& ln = thaw(line);
+	if(ln.size() < _width && line + _active >= getEndLine())
+	{
+		if(ln.empty() && ln.capacity() < _width)
+			ln.swap(_spare);
+		ln.resize(_width, wxTerminalCharacter::DefaultCharacter);
+	}
+	return ln;
+}
+
+wxTerminalLine& wxTerminalContent::operator[](size_t line)
+{
+	// Lines not stored get the scratch line, never the shared blank one: callers may write it.
+	if(line < getFirstLine() || line >= getEndLine())
+	{
+		_outside.clear();
+		return _outside;
+	}
+	// Dropped lines still readable from their block can only be read: return a scratch copy.
+	if(line < _first)
+	{
+		uncompress(line / BLOCK_LINES)[line % BLOCK_LINES].thaw(_outside);
+		return _outside;
+	}
+	return thaw(line);
+}
+
+const wxTerminalLine& wxTerminalContent::operator[](size_t line)const
+{
+	if(line < getFirstLine() || line >= getEndLine())
+		return BlankLine;
+	if(line < _first || getBlock(line)!=NULL)
+	{
+		uncompress(line / BLOCK_LINES)[line % BLOCK_LINES].thaw(_outside);
+		return _outside;
+	}
+	const Slot& s = _lines[slot(line)];
+	if(!s.frozen.empty())
+	{
+		s.frozen.thaw(_outside);
+		return _outside;
+	}
+	return s.line;
+}
+
+void wxTerminalContent::eraseLine(size_t line)
+{
+	if(line < _first || line >= getEndLine())
+		return;
+	if(getBlock(line)!=NULL)
+		expand(line / BLOCK_LINES);
+
+	Slot& s = _lines[slot(line)];
+	s.frozen.clear();
+	s.frozen.setWrapped(false);
+	if(line + _active >= getEndLine())
+		s.line.clear();
+	else
+		wxTerminalLine().swap(s.line);
+}
+
+bool wxTerminalContent::isWrapped(size_t line)const
+{
+	if(line < getFirstLine() || line >= getEndLine())
+		return false;
+	if(line < _first || getBlock(line)!=NULL)
+		return uncompress(line / BLOCK_LINES)[line % BLOCK_LINES].isWrapped();
+	return _lines[slot(line)].frozen.isWrapped();
+}
+
+void wxTerminalContent::setWrapped(size_t line, bool wrapped)
+{
+	if(line < _first || line >= getEndLine())
+		return;
+	if(getBlock(line)!=NULL)
+		expand(line / BLOCK_LINES);
+	_lines[slot(line)].frozen.setWrapped(wrapped);
+}
+
+void wxTerminalContent::setActiveWidth(size_t cols)
+{
+	if(cols==_width)
+		return;
+	_width = cols;
+	_reflowed = getEndLine();
+}
+
+void wxTerminalContent::reflow(size_t line, wxPoint* positions, size_t count)
+{
+	line = std::max(line, _first);
+	size_t end = getReflowedLine();
+	if(line >= end)
+		return;
+
+	// Lines are moved after the rewrapped ones, rewrap at least as many to not move them too often.
+	size_t done = std::max(getEndLine() - end, _active);
+	size_t begin = std::min(line, end - std::min(end - _first, done));
+	rewrap(begin, end, positions, count);
+	_reflowed = begin;
+}
+
+size_t wxTerminalContent::rewrap(size_t& begin, size_t end, wxPoint* positions, size_t count)
+{
+	begin = std::max(begin, _first);
+	end = std::min(end, getEndLine());
+	if(begin >= end || _width==0)
+		return end;
+	while(begin > _first && isWrapped(begin - 1))
+		--begin;
+	while(end < getEndLine() && isWrapped(end - 1))
+		++end;
+
+	// Join the rows of each logical line and split it again at the active width.
+	// Lines are read without being thawed, most of them are not changed.
+	const wxTerminalContent& content = *this;
+	std::vector<wxTerminalLine> rows;
+	std::vector<bool> wraps;
+	std::vector<wxPoint> moved(positions, positions + count);
+	std::vector<size_t> offsets(count);
+	wxTerminalLine logical;
+	bool changed = false;
+	for(size_t n=begin; n<end; )
+	{
+		size_t first = n, row = rows.size();
+		bool wrapped;
+		logical.clear();
+		do
+		{
+			const wxTerminalLine& line = content[n];
+			wrapped = isWrapped(n);
+			size_t size = line.size();
+			if(wrapped)
+				changed |= size!=_width;
+			else
+			{
+				while(size>0 && line[size-1].c==wxTerminalCharacter::DefaultCharacter.c && line[size-1].attr==wxTerminalCharacter::DefaultCharacter.attr)
+					--size;
+				changed |= size>_width;
+			}
+			for(size_t p=0; p<count; ++p)
+				if(positions[p].y>=0 && (size_t)positions[p].y==n)
+					offsets[p] = logical.size() + std::max(positions[p].x, 0);
+			logical.insert(logical.end(), line.begin(), line.begin() + size);
+			++n;
+		}
+		while(wrapped && n<end);
+
+		size_t off = 0;
+		do
+		{
+			size_t size = std::min(_width, logical.size() - off);
+			rows.push_back(wxTerminalLine(logical.begin() + off, logical.begin() + off + size));
+			off += size;
+			wraps.push_back(off < logical.size() || wrapped);
+		}
+		while(off < logical.size());
+
+		// Positions past the text stay on the last row.
+		for(size_t p=0; p<count; ++p)
+		{
+			if(positions[p].y<0 || (size_t)positions[p].y<first || (size_t)positions[p].y>=n)
+				continue;
+			size_t r = std::min(offsets[p] / _width, rows.size() - row - 1);
+			moved[p].x = std::min(offsets[p] - r * _width, _width - 1);
+			moved[p].y = begin + row + r;
+		}
+	}
+	if(!changed)
+		return end;
+
+	// Rows not fitting in the ring with the following lines are dropped, oldest first.
+	size_t oldCount = end - begin, newCount = rows.size(), room = _max - (getEndLine() - end);
+	size_t dropped = newCount > room ? newCount - room : 0;
+	rows.erase(rows.begin(), rows.begin() + dropped);
+	wraps.erase(wraps.begin(), wraps.begin() + dropped);
+	newCount -= dropped;
+
+	// Following lines are moved when the number of lines changes.
+	for(size_t p=0; p<count; ++p)
+	{
+		if(positions[p].y<0 || (size_t)positions[p].y<begin)
+			continue;
+		else if((size_t)positions[p].y>=end)
+			moved[p].y += newCount - oldCount;
+		else if((size_t)moved[p].y >= begin + dropped)
+			moved[p].y -= dropped;
+		else
+			moved[p] = wxPoint(0, begin);
+	}
+	if(newCount > oldCount)
+		insertLines(end, newCount - oldCount);
+	else if(newCount < oldCount)
+		deleteLines(begin + newCount, oldCount - newCount);
+
+	// The insertion may have dropped older lines.
+	for(size_t n=std::max(begin, _first); n<begin+newCount; ++n)
+	{
+		eraseLine(n);
+		Slot& s = _lines[slot(n)];
+		s.line.swap(rows[n - begin]);
+		s.frozen.setWrapped(wraps[n - begin]);
+		if(n + _active < getEndLine())
+			freeze(n);
+	}
+	std::copy(moved.begin(), moved.end(), positions);
+
+	// Blocks expanded to move the lines are cold again.
+	size_t hot = std::max(_hot, _active);
+	if(_compressionLevel>0)
+		for(size_t block=begin / BLOCK_LINES; (block+1) * BLOCK_LINES + hot <= getEndLine(); ++block)
+			compress(block, _compressionLevel);
+	return begin + newCount;
+}
+
+void wxTerminalContent::insertLines(size_t line, size_t count)
+{
+	if(count > _max)
+		count = _max;
+	for(size_t n=0; n<count; ++n)
+		addNewLine();
+
+	// Adding lines may have dropped the oldest ones.
+	if(line < _first)
+		line = _first;
+	expandFrom(line);
+
+	// Move the new blank lines up to the insertion point, only lines after it are touched.
+	for(size_t n=getEndLine(); n-- > line+count; )
+		std::swap(_lines[slot(n)], _lines[slot(n-count)]);
+}
+
+void wxTerminalContent::deleteLines(size_t line, size_t count)
+{
+	if(line < _first)
+		line = _first;
+	if(line >= getEndLine())
+		return;
+	if(count > getEndLine() - line)
+		count = getEndLine() - line;
+	expandFrom(line);
+
+	// Move the following lines up, deleted ones are released at the end of the ring.
+	for(size_t n=line; n+count<getEndLine(); ++n)
+		std::swap(_lines[slot(n)], _lines[slot(n+count)]);
+	_count -= count;
+}
+
+void wxTerminalContent::scrollLines(size_t begin, size_t end, int count)
+{
+	begin = std::max(begin, _first);
+	size_t height = end > begin ? end - begin : 0, n = std::min<size_t>(std::abs(count), height);
+	if(n==0)
+		return;
+	getLine(end - 1);
+	expandFrom(begin);
+
+	// Rotate the slots by reversing both parts then the whole range.
+	size_t middle = begin + (count>0 ? n : height - n);
+	for(size_t a=begin, b=middle; a+1<b; ++a, --b)
+		std::swap(_lines[slot(a)], _lines[slot(b-1)]);
+	for(size_t a=middle, b=end; a+1<b; ++a, --b)
+		std::swap(_lines[slot(a)], _lines[slot(b-1)]);
+	for(size_t a=begin, b=end; a+1<b; ++a, --b)
+		std::swap(_lines[slot(a)], _lines[slot(b-1)]);
+
+	// Lines moved in keep the capacity of the ones moved out.
+	for(size_t line=(count>0 ? end - n : begin), last=line+n; line<last; ++line)
+		eraseLine(line);
+}
+
+void wxTerminalContent::scrollLines(size_t begin, size_t end, int count, size_t left, size_t right)
+{
+	begin = std::max(begin, _first);
+	size_t height = end > begin ? end - begin : 0, n = std::min<size_t>(std::abs(count), height);
+	if(n==0 || left>=right)
+		return;
+	getLine(end - 1);
+	expandFrom(begin);
+
+	// Slots cannot move, the spans are copied from the line count lines away.
+	const wxTerminalCharacter& blank = wxTerminalCharacter::DefaultCharacter;
+	for(size_t k=0; k<height; ++k)
+	{
+		size_t line = count>0 ? begin + k : end - 1 - k;
+		wxTerminalLine& dest = getLine(line);
+		if(dest.size() < right)
+			dest.resize(right, blank);
+		if(k + n < height)
+		{
+			const wxTerminalLine& src = getLine(count>0 ? line + n : line - n);
+			size_t last = std::min(right, src.size());
+			if(last > left)
+				std::copy(src.begin() + left, src.begin() + last, dest.begin() + left);
+			else
+				last = left;
+			std::fill(dest.begin() + last, dest.begin() + right, blank);
+		}
+		else
+			std::fill(dest.begin() + left, dest.begin() + right, blank);
+	}
+}
+
+void wxTerminalContent::scrollColumns(size_t line, size_t left, size_t right, int count)
+{
+	size_t n = std::min<size_t>(std::abs(count), right > left ? right - left : 0);
+	if(n==0 || line < _first)
+		return;
+	wxTerminalLine& ln = getLine(line);
+	if(ln.size() < right)
+		ln.resize(right, wxTerminalCharacter::DefaultCharacter);
+
+	// Characters are trivially copyable, the span is moved with a single memmove.
+	wxTerminalLine::iterator first = ln.begin() + left, last = ln.begin() + right;
+	if(count>0)
+	{
+		std::copy(first + n, last, first);
+		std::fill(last - n, last, wxTerminalCharacter::DefaultCharacter);
+	}
+	else
+	{
+		std::copy_backward(first, last - n, last);
+		std::fill(first, first + n, wxTerminalCharacter::DefaultCharacter);
+	}
+}
+
+void wxTerminalContent::eraseColumns(size_t line, size_t left, size_t right)
+{
+	if(line < _first || line >= getEndLine())
+		return;
+	wxTerminalLine& ln = (*this)[line];
+	right = std::min(right, ln.size());
+	if(left < right)
+		std::fill(ln.begin() + left, ln.begin() + right, wxTerminalCharacter::DefaultCharacter);
+}
+
+void wxTerminalContent::clear()
+{
+	_lines.clear();
+	_start = 0;
+	_first = 0;
+	_count = 0;
+	_reflowed = 0;
+	_blocks.clear();
+	_firstBlock = 0;
+	_cache.clear();
+	if(_spill!=NULL)
+		_spill->clear();
+}
+
+size_t wxTerminalContent::getFirstLine()const
+{
+	// Without spill file, lines are readable up to the ring only.
+	if(_spill==NULL)
+		return _first;
+	size_t first = _first;
+	if(!_blocks.empty() && !_blocks.front().data.empty())
+		first = std::min(first, _firstBlock * BLOCK_LINES);
+	if(_spill->getEndBlock() > _spill->getFirstBlock())
+		first = std::min(first, _spill->getFirstBlock() * BLOCK_LINES);
+	return first;
+}
+
+bool wxTerminalContent::setSpill(size_t maxBytes, const wxString& path)
+{
+	delete _spill;
+	_spill = NULL;
+	_cache.clear();
+	if(maxBytes==0)
+		return true;
+#if wxUSE_ZLIB
+	_spill = new wxTerminalSpillFile;
+	if(_spill->open(path, maxBytes))
+		return true;
+	delete _spill;
+	_spill = NULL;
+#endif
+	return false;
+}
+
+void wxTerminalContent::save(wxTerminalSessionWriter& out)const
+{
+	out.write<wxUint64>(_first);
+	out.write<wxUint64>(_count);
+	out.write<wxUint64>(_max);
+	out.write<wxUint64>(_active);
+	out.write<wxUint64>(_hot);
+	out.write<wxInt32>(_compressionLevel);
+
+	// Compressed blocks, spilled ones first, written as they are.
+	size_t begin = _firstBlock, end = _firstBlock + _blocks.size();
+	if(_spill!=NULL && _spill->getEndBlock() > _spill->getFirstBlock())
+	{
+		begin = std::min(begin, _spill->getFirstBlock());
+		end = std::max(end, _spill->getEndBlock());
+	}
+	size_t size, words, count = 0;
+	for(size_t block=begin; block<end; ++block)
+		if(getBlockData(block, size, words)!=NULL)
+			++count;
+	out.write<wxUint64>(count);
+	for(size_t block=begin; block<end; ++block)
+	{
+		const unsigned char* data = getBlockData(block, size, words);
+		if(data==NULL)
+			continue;
+		out.write<wxUint64>(block);
+		out.write<wxUint64>(size);
+		out.write<wxUint64>(words);
+		out.write(data, size);
+		out.align();
+	}
+
+	// Other lines, frozen.
+	count = 0;
+	for(size_t n=_first; n<getEndLine(); ++n)
+		if(getBlock(n)==NULL)
+			++count;
+	out.write<wxUint64>(count);
+	std::vector<unsigned int> buffer;
+	wxTerminalFrozenLine frozen;
+	for(size_t n=_first; n<getEndLine(); ++n)
+	{
+		if(getBlock(n)!=NULL)
+			continue;
+		const Slot& s = _lines[slot(n)];
+		buffer.clear();
+		if(s.frozen.empty())
+		{
+			frozen.freeze(s.line);
+			frozen.setWrapped(s.frozen.isWrapped());
+			frozen.save(buffer);
+		}
+		else
+			s.frozen.save(buffer);
+		out.write(&buffer[0], buffer.size() * sizeof(unsigned int));
+	}
+}
+
+bool wxTerminalContent::load(wxTerminalSessionReader& in)
+{
+	clear();
+
+	wxUint64 first, count, max, active, hot, blocks;
+	wxInt32 level;
+	if(!in.read(first) || !in.read(count) || !in.read(max) || !in.read(active) || !in.read(hot) || !in.read(level)
+			|| !in.read(blocks) || max==0 || max>MAX_SESSION_LINES || count>max || active>MAX_SESSION_LINES || hot>MAX_SESSION_LINES
+			|| first > (wxUint64)std::numeric_limits<size_t>::max() - max || count / BLOCK_LINES > in.getRemaining() / sizeof(unsigned int))
+	{
+		clear();
+		return false;
+	}
+	_first = first;
+	_count = count;
+	_max = max;
+	_active = active;
+	_hot = hot;
+	_compressionLevel = level;
+	_lines.reserve(_count);
+	_lines.resize(_count);
+
+	// Blocks are kept compressed, older ones than the ring go to the spill file.
+	for(wxUint64 n=0; n<blocks; ++n)
+	{
+		wxUint64 block, size, words;
+		const unsigned char* data;
+		if(!in.read(block) || !in.read(size) || !in.read(words) || (data = in.skip(size))==NULL || !in.align()
+				|| size==0 || words>MAX_BLOCK_WORDS || block >= getEndLine() / BLOCK_LINES
+				|| (!_blocks.empty() && block < _firstBlock + _blocks.size()))
+		{
+			clear();
+			return false;
+		}
+		if((block+1) * BLOCK_LINES <= _first)
+		{
+			if(_spill!=NULL)
+				_spill->append(block, data, size, words);
+			continue;
+		}
+		if(_blocks.empty())
+			_firstBlock = block;
+		while(_firstBlock + _blocks.size() <= block)
+			_blocks.push_back(Block());
+		Block& b = _blocks.back();
+		b.data.assign(data, data + size);
+		b.size = words;
+	}
+
+	// Other lines are restored frozen, in place from the session.
+	wxUint64 lines;
+	if(!in.read(lines))
+	{
+		clear();
+		return false;
+	}
+	const unsigned int* begin = (const unsigned int*)in.getData();
+	const unsigned int* end = begin + in.getRemaining() / sizeof(unsigned int);
+	const unsigned int* data = begin;
+	for(size_t n=_first; n<getEndLine() && data!=NULL; ++n)
+	{
+		if(getBlock(n)!=NULL)
+			continue;
+		data = _lines[slot(n)].frozen.load(data, end);
+		--lines;
+	}
+	if(data==NULL || lines!=0)
+	{
+		clear();
+		return false;
+	}
+	in.skip((data - begin) * sizeof(unsigned int));
+	return true;
+}
+
+void wxTerminalContent::setMaxLines(size_t maxLines)
+{
+	if(maxLines==0)
+		maxLines = 1;
+
+	// Linearize the ring, keeping the newest lines.
+	size_t drop = _count > maxLines ? _count - maxLines : 0;
+	std::vector<Slot> lines;
+	lines.reserve(_count - drop);
+	for(size_t n=_first+drop; n<getEndLine(); ++n)
+		lines.push_back(std::move(_lines[slot(n)]));
+
+	_lines.swap(lines);
+	_start = 0;
+	_first += drop;
+	_count -= drop;
+	_max = maxLines;
+	dropBlocks();
+}
+
+wxTerminalCharacter& wxTerminalContent::getChar(size_t line, size_t col)
+{
+	wxTerminalLine& ln = getLine(line);
+
+	// Ensure the character exisits in the line, create it if not.
+	if(ln.size()<=col)
+		ln.resize(col+1, wxTerminalCharacter::DefaultCharacter);
+
+	// Return the wanted character.
+	return ln.at(col);
+}
 
 //
 //
-// Debug features:
+// wxTerminalHyperlinkTable
 //
 //
-#if 1 // Debuging feature activated
 
-#define DBGOUT (std::cout)
-#define NOT_IMPLEMENTED(content) {DBGOUT << "Not implemented: " << content << std::endl;}
+wxTerminalHyperlinkTable::wxTerminalHyperlinkTable():
+_length(0)
+{
+}
 
-#else  // Debuging feature activated
+unsigned short wxTerminalHyperlinkTable::intern(const wxString& uri, unsigned short kept)
+{
+	std::unordered_map<wxString, unsigned short, wxStringHash>::const_iterator it = _ids.find(uri);
+	if(it!=_ids.end())
+		return it->second;
+	if(uri.empty() || uri.length() > MAX_URI_LENGTH)
+		return 0;
 
-#define NOT_IMPLEMENTED(content);
+	// Make room by dropping the URIs of unreferenced ids.
+	for(size_t n=0; n<_free.size() && _length + uri.length() > MAX_TOTAL_LENGTH; ++n)
+		if(_entries[_free[n]-1].free && _free[n]!=kept)
+			drop(_free[n]);
+	if(_length + uri.length() > MAX_TOTAL_LENGTH)
+		return 0;
 
-#endif // Debuging feature activated
+	// Reuse an unreferenced id, entries referenced again since they were freed are skipped.
+	unsigned short id = 0;
+	while(id==0 && !_free.empty())
+	{
+		unsigned short n = _free.back();
+		_free.pop_back();
+		if(_entries[n-1].free && n!=kept)
+			id = n;
+	}
+	if(kept>0 && kept<=_entries.size() && _entries[kept-1].free)
+		_free.push_back(kept);
+	if(id!=0)
+		drop(id);
+	else if(_entries.size() < MAX_IDS)
+	{
+		Entry entry = {wxString(), 0, false};
+		_entries.push_back(entry);
+		id = _entries.size();
+	}
+	else
+		return 0;
 
+	// Unreferenced until characters are written with it.
+	Entry& entry = _entries[id-1];
+	entry.uri = uri;
+	entry.free = true;
+	_free.push_back(id);
+	_ids[uri] = id;
+	_length += uri.length();
+	return id;
+}
 
+void wxTerminalHyperlinkTable::retain(unsigned short id)
+{
+	if(id==0 || id>_entries.size())
+		return;
+	++_entries[id-1].refs;
+	_entries[id-1].free = false;
+}
 
-#if 0 // Tracing  feature activated
+void wxTerminalHyperlinkTable::release(unsigned short id)
+{
+	if(id==0 || id>_entries.size())
+		return;
+	Entry& entry = _entries[id-1];
+	if(entry.refs>0 && --entry.refs==0 && !entry.free)
+	{
+		entry.free = true;
+		_free.push_back(id);
+	}
+}
 
-#define TRACEOUT (std::cout)
-#define TRACE(content) {TRACEOUT << content << std::endl;}
+void wxTerminalHyperlinkTable::drop(unsigned short id)
+{
+	Entry& entry = _entries[id-1];
+	std::unordered_map<wxString, unsigned short, wxStringHash>::iterator it = _ids.find(entry.uri);
+	if(it!=_ids.end() && it->second==id)
+		_ids.erase(it);
+	_length -= entry.uri.length();
+	wxString().swap(entry.uri);
+}
 
-#else // Tracing  feature activated
+void wxTerminalHyperlinkTable::clear()
+{
+	_entries.clear();
+	_free.clear();
+	_ids.clear();
+	_length = 0;
+}
 
-#define TRACE(content);
+void wxTerminalHyperlinkTable::save(wxTerminalSessionWriter& out)const
+{
+	out.write<wxUint32>(_entries.size());
+	for(size_t n=0; n<_entries.size(); ++n)
+		out.write(_entries[n].uri);
+}
 
-#endif  // Tracing  feature activated
+bool wxTerminalHyperlinkTable::load(wxTerminalSessionReader& in)
+{
+	clear();
+	wxUint32 count;
+	if(!in.read(count) || count>MAX_IDS)
+		return false;
+	_entries.resize(count);
+	for(size_t n=0; n<count; ++n)
+	{
+		Entry& entry = _entries[n];
+		if(!in.read(entry.uri) || entry.uri.length() > MAX_URI_LENGTH)
+		{
+			clear();
+			return false;
+		}
+		_length += entry.uri.length();
+		if(!entry.uri.empty())
+			_ids.insert(std::make_pair(entry.uri, (unsigned short)(n + 1)));
+	}
+	if(_length > MAX_TOTAL_LENGTH)
+	{
+		clear();
+		return false;
+	}
 
+	// Ids are referenced again by the attributes loaded next, the lowest ones are reused first.
+	for(size_t id=count; id>0; --id)
+	{
+		_entries[id-1].refs = 0;
+		_entries[id-1].free = true;
+		_free.push_back(id);
+	}
+	return true;
+}
 
 //
 //
-// Predefined char sequences
+// wxTerminalAttributeTable
 //
 //
 
-#define _ESC "\x1B"
-#define _CSI _ESC "["
-#define _SS3 _ESC "O"
+wxTerminalAttributeTable::wxTerminalAttributeTable():
+_hyperlinks(NULL)
+{
+	clear();
+}
 
+void wxTerminalAttributeTable::setHyperlinkTable(wxTerminalHyperlinkTable* hyperlinks)
+{
+	// Live entries move their reference to the new table.
+	for(std::unordered_map<wxTerminalCharacterAttributes, unsigned short, Hash>::const_iterator it=_indexes.begin(); it!=_indexes.end(); ++it)
+	{
+		if(_hyperlinks!=NULL)
+			_hyperlinks->release(it->first.hyperlink);
+		if(hyperlinks!=NULL)
+			hyperlinks->retain(it->first.hyperlink);
+	}
+	_hyperlinks = hyperlinks;
+}
 
-//
-//
-// wxTerminalCharacter
-//
-//
+unsigned short wxTerminalAttributeTable::intern(const wxTerminalCharacterAttributes& attr)
+{
+	if(_entries[_last]==attr)
+		return _last;
 
-wxTerminalCharacter wxTerminalCharacter::DefaultCharacter = { 0, { 7, 0, wxTCS_Invisible} };
+	std::unordered_map<wxTerminalCharacterAttributes, unsigned short, Hash>::const_iterator it = _indexes.find(attr);
+	if(it!=_indexes.end())
+		return _last = it->second;
 
-//
-//
-// wxTerminalContent
-//
-//
+	unsigned short index;
+	if(!_free.empty())
+	{
+		index = _free.back();
+		_free.pop_back();
+		_entries[index] = attr;
+	}
+	else if(_entries.size()<MAX_ENTRIES)
+	{
+		index = _entries.size();
+		_entries.push_back(attr);
+	}
+	else
+		return DEFAULT_INDEX;
 
-void wxTerminalContent::setChar(wxPoint pos, wxTerminalCharacter c)
-{
-	getChar(pos.y, pos.x) = c;
+	_indexes[attr] = index;
+	if(_hyperlinks!=NULL)
+		_hyperlinks->retain(attr.hyperlink);
+	return _last = index;
 }
 
-void wxTerminalContent::insertChar(wxPoint pos, wxTerminalCharacter c)
+unsigned short wxTerminalAttributeTable::nearest(const wxTerminalCharacterAttributes& attr)const
 {
-	getChar(pos.y, pos.x);
-	wxTerminalLine& line = at(pos.y);
-	line.insert(line.begin()+pos.x, c);
+	wxTerminalCharacterAttributes near = attr;
+	for(int step=0; step<4; ++step)
+	{
+		switch(step)
+		{
+		case 0: near.hyperlink = 0; break;
+		case 1: near.back = 0; break;
+		case 2: near.fore = 7; break;
+		case 3: near.style = wxTCS_Normal; near.underline = wxTUS_Single; break;
+		}
+		std::unordered_map<wxTerminalCharacterAttributes, unsigned short, Hash>::const_iterator it = _indexes.find(near);
+		if(it!=_indexes.end())
+			return it->second;
+	}
+	// Otherwise the attributes of the previous characters are kept.
+	return _last;
 }
 
-void wxTerminalContent::addNewLine()
+size_t wxTerminalAttributeTable::collect(const wxTerminalContent& content)
 {
-	push_back(wxTerminalLine());
+	std::vector<bool> used(_entries.size(), false);
+	used[DEFAULT_INDEX] = true;
+	for(size_t n=content.getFirstLine(); n<content.getEndLine(); ++n)
+	{
+		const wxTerminalLine& line = content[n];
+		for(size_t col=0; col<line.size(); ++col)
+			used[line[col].attr] = true;
+	}
+
+	// Walk backward so the lowest indexes are reused first.
+	_free.clear();
+	for(size_t index=_entries.size(); index-- > 0; )
+	{
+		if(!used[index])
+		{
+			// Entries released by a previous collect may be stale copies of a live one.
+			std::unordered_map<wxTerminalCharacterAttributes, unsigned short, Hash>::iterator it = _indexes.find(_entries[index]);
+			if(it!=_indexes.end() && it->second==index)
+			{
+				_indexes.erase(it);
+				if(_hyperlinks!=NULL)
+					_hyperlinks->release(_entries[index].hyperlink);
+			}
+			_free.push_back(index);
+		}
+	}
+	if(!used[_last])
+		_last = DEFAULT_INDEX;
+	return _free.size();
 }
 
-wxTerminalLine& wxTerminalContent::getLine(size_t line)
+void wxTerminalAttributeTable::clear()
 {
-	// Ensure has line, create it if not.
-	if(size()<=line)
-		resize(line+1);
+	if(_hyperlinks!=NULL)
+		for(std::unordered_map<wxTerminalCharacterAttributes, unsigned short, Hash>::const_iterator it=_indexes.begin(); it!=_indexes.end(); ++it)
+			_hyperlinks->release(it->first.hyperlink);
 
-	// Return the wanted line.
-	return at(line);
+	wxTerminalCharacterAttributes def = {7, 0, wxTCS_Invisible};
+	_entries.assign(1, def);
+	_free.clear();
+	_indexes.clear();
+	_indexes[def] = DEFAULT_INDEX;
+	_last = DEFAULT_INDEX;
 }
 
-wxTerminalCharacter& wxTerminalContent::getChar(size_t line, size_t col)
+void wxTerminalAttributeTable::save(wxTerminalSessionWriter& out)const
 {
-	wxTerminalLine& ln = getLine(line);
+	out.write<wxUint32>(_entries.size());
+	for(size_t n=0; n<_entries.size(); ++n)
+		out.write(_entries[n]);
+	out.write<wxUint32>(_free.size());
+	for(size_t n=0; n<_free.size(); ++n)
+		out.write<wxUint16>(_free[n]);
+}
 
-	// Ensure the character exisits in the line, create it if not.
-	if(ln.size()<=col)
-		ln.resize(col+1, wxTerminalCharacter::DefaultCharacter);
+bool wxTerminalAttributeTable::load(wxTerminalSessionReader& in)
+{
+	clear();
+	wxUint32 count, freeCount;
+	bool ok = in.read(count) && count>0 && count<=MAX_ENTRIES;
+	if(ok)
+	{
+		_entries.resize(count);
+		for(size_t n=0; n<count && ok; ++n)
+			ok = in.read(_entries[n]) && (_hyperlinks==NULL || _entries[n].hyperlink<=_hyperlinks->getCount());
+	}
+	ok = ok && in.read(freeCount) && freeCount<count;
+	std::vector<bool> released(count, false);
+	if(ok)
+	{
+		_free.resize(freeCount);
+		for(size_t n=0; n<freeCount && ok; ++n)
+		{
+			wxUint16 index;
+			ok = in.read(index) && index!=DEFAULT_INDEX && index<count;
+			if(ok)
+			{
+				_free[n] = index;
+				released[index] = true;
+			}
+		}
+	}
+	if(!ok)
+	{
+		clear();
+		return false;
+	}
 
-	// Return the wanted character.
-	return ln.at(col);
+	_indexes.clear();
+	for(size_t index=0; index<count; ++index)
+		if(!released[index] && _indexes.insert(std::make_pair(_entries[index], (unsigned short)index)).second && _hyperlinks!=NULL)
+			_hyperlinks->retain(_entries[index].hyperlink);
+	_last = DEFAULT_INDEX;
+	return true;
 }
 
 //
@@ -135,33 +1740,165 @@ wxTerminalCharacter& wxTerminalContent::getChar(size_t line, size_t col)
 wxTerminalScreen::wxTerminalScreen():
 _originPosition(0, 0),
 _caretPosition(0,0),
-_size(80, 25)
+_size(80, 25),
+_reflow(true),
+_scrollTop(0),
+_scrollBottom(24),
+_scrollLeft(0),
+_scrollRight(79),
+_lastDamage(0),
+_damageAll(true),
+_damageOrigin(0),
+_collectLine(0),
+_collectMisses(0)
 {
 }
 
 void wxTerminalScreen::clear()
 {
 	_content.clear();
+	_attributes.clear();
+	_collectLine = 0;
+	_collectMisses = 0;
 	_originPosition = wxPoint(0, 0);
 	_caretPosition = wxPoint(0, 0);
 	// NOTE: Dont reset screen size.
+	damageAll();
+}
+
+void wxTerminalScreen::save(wxTerminalSessionWriter& out)const
+{
+	_content.save(out);
+	_attributes.save(out);
+	out.write<wxInt32>(_originPosition.x);
+	out.write<wxInt32>(_originPosition.y);
+	out.write<wxInt32>(_caretPosition.x);
+	out.write<wxInt32>(_caretPosition.y);
+	out.write<wxInt32>(_size.x);
+	out.write<wxInt32>(_size.y);
+	out.align();
+}
+
+bool wxTerminalScreen::load(wxTerminalSessionReader& in)
+{
+	wxInt32 values[6];
+	if(!_content.load(in) || !_attributes.load(in) || !in.read(values) || !in.align()
+			|| values[4]<=0 || values[5]<=0 || !checkAttributes())
+	{
+		clear();
+		return false;
+	}
+	_originPosition = wxPoint(values[0], values[1]);
+	_caretPosition = wxPoint(values[2], values[3]);
+	_size = wxSize(values[4], values[5]);
+	setScrollMargins(0, _size.y - 1);
+	setHorizontalMargins(0, _size.x - 1);
+	_collectLine = 0;
+	_collectMisses = 0;
+	// Restored lines are wrapped at the saved width.
+	_content.setActiveLines(_size.y);
+	_content.setActiveWidth(_size.x);
+	damageAll();
+	return true;
+}
+
+bool wxTerminalScreen::checkAttributes()const
+{
+	const wxTerminalContent& content = _content;
+	for(size_t n=content.getFirstLine(); n<content.getEndLine(); ++n)
+	{
+		const wxTerminalLine& line = content[n];
+		for(size_t col=0; col<line.size(); ++col)
+			if(line[col].attr >= _attributes.getEntryCount())
+				return false;
+	}
+	return true;
+}
+
+void wxTerminalScreen::damageLine(size_t line, int begin, int end)
+{
+	if(_damageAll)
+		return;
+	std::vector<Damage>::iterator it;
+	if(_lastDamage < _damagedLines.size() && _damagedLines[_lastDamage].line==line)
+		it = _damagedLines.begin() + _lastDamage;
+	else
+	{
+		it = std::lower_bound(_damagedLines.begin(), _damagedLines.end(), line);
+		if(it==_damagedLines.end() || it->line!=line)
+		{
+			Damage damage = {line, begin, end};
+			it = _damagedLines.insert(it, damage);
+		}
+		_lastDamage = it - _damagedLines.begin();
+	}
+	it->begin = std::min(it->begin, begin);
+	it->end = std::max(it->end, end);
+}
+
+void wxTerminalScreen::eraseLineAbsolute(size_t line)
+{
+	damageLine(line);
+	_content.eraseLine(line);
+}
+
+void wxTerminalScreen::damageLines(size_t begin, size_t end)
+{
+	// Only lines on screen matter, the others are drawn when scrolled to.
+	begin = std::max(begin, getOriginLine());
+	end = std::min(end, getOriginLine() + _size.y);
+	for(size_t line=begin; line<end; ++line)
+		damageLine(line);
+}
+
+void wxTerminalScreen::clearDamage()
+{
+	_damagedLines.clear();
+	_damageAll = false;
+	_damageOrigin = getOriginLine();
+}
+
+void wxTerminalScreen::addStatistics(wxTerminalMemoryStatistics& stats)const
+{
+	_content.addStatistics(stats);
+	stats.attributes += _attributes.size();
+}
+
+unsigned short wxTerminalScreen::getAttributeIndex(const wxTerminalCharacterAttributes& attr)
+{
+	unsigned short index = _attributes.intern(attr);
+	if(index!=wxTerminalAttributeTable::DEFAULT_INDEX || !_attributes.full() || attr==_attributes.get(index))
+		return index;
+
+	// The table is full. Collecting scans the whole history, after a scan releasing too few
+	// entries, the next one waits for enough new lines or missing attributes.
+	if(++_collectMisses >= wxTerminalAttributeTable::COLLECT_DELAY_MISSES || _content.getEndLine() >= _collectLine)
+	{
+		size_t released = _attributes.collect(_content);
+		_collectMisses = 0;
+		_collectLine = released < wxTerminalAttributeTable::MIN_COLLECTED ? _content.getEndLine() + wxTerminalAttributeTable::COLLECT_DELAY_LINES : 0;
+		if(released>0)
+			return _attributes.intern(attr);
+	}
+	return _attributes.nearest(attr);
 }
 
 void wxTerminalScreen::setChar(wxPoint pos, wxTerminalCharacter ch)
 {
-	_content.setChar(pos + _originPosition, ch);
+	setCharAbsolute(pos + getOrigin(), ch);
 }
 
 void wxTerminalScreen::setChar(wxPoint pos, wxUniChar c, const wxTerminalCharacterAttributes& attr)
 {
 	wxTerminalCharacter ch;
 	ch.c     = c;
-	ch.attr  = attr;
-	_content.setChar(pos + _originPosition, ch);
+	ch.attr  = getAttributeIndex(attr);
+	setCharAbsolute(pos + getOrigin(), ch);
 }
 
 void wxTerminalScreen::setCharAbsolute(wxPoint pos, wxTerminalCharacter ch)
 {
+	damageLine(pos.y, pos.x, pos.x + 1);
 	_content.setChar(pos, ch);
 }
 
@@ -169,28 +1906,28 @@ void wxTerminalScreen::setCharAbsolute(wxPoint pos, wxUniChar c, const wxTermina
 {
 	wxTerminalCharacter ch;
 	ch.c     = c;
-	ch.attr  = attr;
-	_content.setChar(pos, ch);
+	ch.attr  = getAttributeIndex(attr);
+	setCharAbsolute(pos, ch);
 }
 
 
 void wxTerminalScreen::insertChar(wxPoint pos, wxTerminalCharacter ch)
 {
-	_content.insertChar(pos + _originPosition, ch);
-	// TODO Validate content here ? (split long lines ?)
+	insertCharAbsolute(pos + getOrigin(), ch);
 }
 
 void wxTerminalScreen::insertChar(wxPoint pos, wxUniChar c, const wxTerminalCharacterAttributes& attr)
 {
 	wxTerminalCharacter ch;
 	ch.c     = c;
-	ch.attr  = attr;
-	// TODO Validate content here ? (split long lines ?)
-	_content.insertChar(pos + _originPosition, ch);
+	ch.attr  = getAttributeIndex(attr);
+	insertCharAbsolute(pos + getOrigin(), ch);
 }
 
 void wxTerminalScreen::insertCharAbsolute(wxPoint pos, wxTerminalCharacter ch)
 {
+	// Following characters are shifted.
+	damageLine(pos.y, pos.x);
 	_content.insertChar(pos, ch);
 	// TODO Validate content here ? (split long lines ?)
 }
@@ -199,14 +1936,13 @@ void wxTerminalScreen::insertCharAbsolute(wxPoint pos, wxUniChar c, const wxTerm
 {
 	wxTerminalCharacter ch;
 	ch.c     = c;
-	ch.attr  = attr;
-	// TODO Validate content here ? (split long lines ?)
-	_content.insertChar(pos, ch);
+	ch.attr  = getAttributeIndex(attr);
+	insertCharAbsolute(pos, ch);
 }
 
 void wxTerminalScreen::setCaretPosition(wxPoint pos)
 {
-	_caretPosition = pos + _originPosition;
+	_caretPosition = pos + getOrigin();
 }
 
 void wxTerminalScreen::setCaretAbsolutePosition(wxPoint pos)
@@ -214,27 +1950,57 @@ void wxTerminalScreen::setCaretAbsolutePosition(wxPoint pos)
 	_caretPosition = pos;
 }
 
+void wxTerminalScreen::setScreenSize(wxSize sz)
+{
+	bool rewrap = _reflow && sz.x!=_size.x && sz.x>0;
+	_size = sz;
+	setScrollMargins(0, sz.y - 1);
+	setHorizontalMargins(0, sz.x - 1);
+	_content.setActiveLines(sz.y);
+	_content.setActiveWidth(sz.x);
+
+	// Shown rows and the active area are rewrapped now, older ones when shown.
+	size_t end = _content.getEndLine();
+	if(rewrap)
+		reflowHistory(std::min(getOriginLine(), end > (size_t)sz.y ? end - sz.y : 0));
+	else if(sz.x>0 && _caretPosition.x>=sz.x)
+		_caretPosition.x = sz.x - 1;
+	damageAll();
+}
+
+void wxTerminalScreen::reflowHistory(size_t line)
+{
+	if(line >= _content.getReflowedLine())
+		return;
+	wxPoint positions[2] = {_caretPosition, wxPoint(0, getOriginLine())};
+	_content.reflow(line, positions, 2);
+	_caretPosition = positions[0];
+	_originPosition.y = positions[1].y;
+	damageAll();
+}
+
 void wxTerminalScreen::moveOrigin(int lines)
 {
-	_originPosition.y += lines;
-	if(_originPosition.y<0) // Sanitize to 0 (origin cannot be before begining of history).
-		_originPosition.y = 0;
+	setOrigin(getOriginLine() + lines);
 }
 
 void wxTerminalScreen::setOrigin(int lines)
 {
 	_originPosition.y = lines;
-	if(_originPosition.y<0) // Sanitize to 0 (origin cannot be before begining of history).
-		_originPosition.y = 0;
+	if(_originPosition.y<(int)_content.getFirstLine()) // Sanitize (origin cannot be before begining of history).
+		_originPosition.y = _content.getFirstLine();
+
+	// History shown for the first time since a resize is rewrapped now.
+	if(_reflow)
+		reflowHistory(_originPosition.y);
 }
 
 void wxTerminalScreen::insertChar(wxUniChar c, const wxTerminalCharacterAttributes& attr)
 {
 	wxTerminalCharacter ch;
 	ch.c     = c;
-	ch.attr  = attr;
-	_content.insertChar(_caretPosition, ch);
-	// TODO Validate content here ? (split long lines ?)
+	ch.attr  = getAttributeIndex(attr);
+	insertCharAbsolute(_caretPosition, ch);
 	moveCaret(0, 1);
 }
 
@@ -242,19 +2008,150 @@ void wxTerminalScreen::overwriteChar(wxUniChar c, const wxTerminalCharacterAttri
 {
 	wxTerminalCharacter ch;
 	ch.c     = c;
-	ch.attr  = attr;
-	_content.setChar(_caretPosition, ch);
+	ch.attr  = getAttributeIndex(attr);
+	setCharAbsolute(_caretPosition, ch);
 	moveCaret(0, 1);
 }
 
+void wxTerminalScreen::insertBlanks(unsigned int count)
+{
+	int right = getRowEnd(_caretPosition.x);
+	if(count==0 || _caretPosition.x>right)
+		return;
+	damageLine(_caretPosition.y, _caretPosition.x, right + 1);
+	_content.scrollColumns(_caretPosition.y, _caretPosition.x, right + 1, -(int)std::min<unsigned int>(count, right + 1 - _caretPosition.x));
+}
+
+void wxTerminalScreen::deleteCells(unsigned int count)
+{
+	int right = getRowEnd(_caretPosition.x);
+	if(count==0 || _caretPosition.x>right)
+		return;
+	damageLine(_caretPosition.y, _caretPosition.x, right + 1);
+	_content.scrollColumns(_caretPosition.y, _caretPosition.x, right + 1, std::min<unsigned int>(count, right + 1 - _caretPosition.x));
+}
+
+void wxTerminalScreen::eraseCells(unsigned int count)
+{
+	int end = std::min<int>(_caretPosition.x + std::min<unsigned int>(count, _size.x), _size.x);
+	if(end <= _caretPosition.x)
+		return;
+	damageLine(_caretPosition.y, _caretPosition.x, end);
+	_content.eraseColumns(_caretPosition.y, _caretPosition.x, end);
+}
+
+/**
+ * Clip a rectangle to a size.
+ */
+static wxRect ClipRectangle(const wxRect& rect, wxSize size)
+{
+	int left = std::max(rect.x, 0), top = std::max(rect.y, 0);
+	int right = std::min(rect.x + rect.width, size.x), bottom = std::min(rect.y + rect.height, size.y);
+	return wxRect(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+}
+
+void wxTerminalScreen::fillRectangle(const wxRect& rect, wxTerminalCharacter ch)
+{
+	wxRect area = ClipRectangle(rect, _size);
+	if(area.width<=0 || area.height<=0)
+		return;
+	for(size_t line=area.y + getOriginLine(), end=line + area.height; line<end; ++line)
+	{
+		wxTerminalLine& row = _content.getLine(line);
+		if(row.size() < (size_t)(area.x + area.width))
+			row.resize(area.x + area.width, wxTerminalCharacter::DefaultCharacter);
+		damageLine(line, area.x, area.x + area.width);
+		FillCells(&row[area.x], area.width, ch);
+	}
+}
+
+void wxTerminalScreen::fillRectangle(const wxRect& rect, wxUniChar c, const wxTerminalCharacterAttributes& attr)
+{
+	wxTerminalCharacter ch;
+	ch.c     = c;
+	ch.attr  = getAttributeIndex(attr);
+	fillRectangle(rect, ch);
+}
+
+void wxTerminalScreen::copyRectangle(const wxRect& rect, wxPoint dest)
+{
+	// The source is clipped, then the destination with the same offsets.
+	wxRect area = ClipRectangle(rect, _size);
+	dest = dest + wxPoint(area.x - rect.x, area.y - rect.y);
+	wxRect target = ClipRectangle(wxRect(dest.x, dest.y, area.width, area.height), _size);
+	area = wxRect(area.x + target.x - dest.x, area.y + target.y - dest.y, target.width, target.height);
+	if(area.width<=0 || area.height<=0 || (area.x==target.x && area.y==target.y))
+		return;
+
+	// Rows are copied in the order which does not overwrite the ones still to copy.
+	size_t origin = getOriginLine(), width = area.width;
+	_content.getLine(origin + std::max(area.y, target.y) + area.height - 1);
+	for(int n=0; n<area.height; ++n)
+	{
+		int k = target.y > area.y ? area.height - 1 - n : n;
+		size_t from = origin + area.y + k, to = origin + target.y + k;
+		wxTerminalLine& src = _content.getLine(from);
+		if(src.size() < area.x + width)
+			src.resize(area.x + width, wxTerminalCharacter::DefaultCharacter);
+		wxTerminalLine& dst = _content.getLine(to);
+		if(dst.size() < target.x + width)
+			dst.resize(target.x + width, wxTerminalCharacter::DefaultCharacter);
+		damageLine(to, target.x, target.x + width);
+		// Spans are copied with memmove, in the right direction when they overlap in the same row.
+		if(target.x <= area.x)
+			std::copy(src.begin() + area.x, src.begin() + area.x + width, dst.begin() + target.x);
+		else
+			std::copy_backward(src.begin() + area.x, src.begin() + area.x + width, dst.begin() + target.x + width);
+	}
+}
+
+void wxTerminalScreen::changeRectangleStyle(const wxRect& rect, unsigned char clear, unsigned char set, unsigned char toggle)
+{
+	wxRect area = ClipRectangle(rect, _size);
+	if(area.width<=0 || area.height<=0)
+		return;
+
+	// Cells are remapped by runs of attribute index, with a few recent mappings to avoid interning attributes each time.
+	enum { MAPPINGS = 8 };
+	unsigned short from[MAPPINGS], to[MAPPINGS];
+	size_t mappings = 0, next = 0;
+	for(size_t line=area.y + getOriginLine(), end=line + area.height; line<end; ++line)
+	{
+		wxTerminalLine& row = _content.getLine(line);
+		if(row.size() < (size_t)(area.x + area.width))
+			row.resize(area.x + area.width, wxTerminalCharacter::DefaultCharacter);
+		damageLine(line, area.x, area.x + area.width);
+		for(size_t col=area.x, last=area.x + area.width; col<last; )
+		{
+			unsigned short index = row[col].attr;
+			size_t m = 0;
+			while(m<mappings && from[m]!=index)
+				++m;
+			if(m==mappings)
+			{
+				wxTerminalCharacterAttributes attr = _attributes.get(index);
+				attr.style = ((attr.style & ~clear) | set) ^ toggle;
+				// Interning may collect unreferenced entries, mappings not written yet are then invalid.
+				if(_attributes.full())
+					mappings = next = 0;
+				m = mappings<MAPPINGS ? mappings++ : next++ % MAPPINGS;
+				from[m] = index;
+				to[m] = getAttributeIndex(attr);
+			}
+			col += ReplaceAttribute(&row[col], last - col, index, to[m]);
+		}
+	}
+}
+
 void wxTerminalScreen::insertLines(int pos, unsigned int count)
 {
-	_content.insert(_content.begin()+pos+_originPosition.y, count, wxTerminalLine());
+	insertLinesAbsolute(pos + getOriginLine(), count);
 }
 
 void wxTerminalScreen::insertLinesAbsolute(int pos, unsigned int count)
 {
-	_content.insert(_content.begin()+pos, count, wxTerminalLine());
+	_content.insertLines(pos, count);
+	damageLines(pos, _content.getEndLine());
 }
 
 void wxTerminalScreen::insertLinesAtCarret(unsigned int count)
@@ -264,16 +2161,14 @@ void wxTerminalScreen::insertLinesAtCarret(unsigned int count)
 
 void wxTerminalScreen::deleteLines(int pos, unsigned int count)
 {
-	deleteLinesAbsolute(pos + _originPosition.y, count);
+	deleteLinesAbsolute(pos + getOriginLine(), count);
 }
 
 void wxTerminalScreen::deleteLinesAbsolute(int pos, unsigned int count)
 {
-	int end = pos + count;
-	if(end<_content.size())
-	   _content.erase(_content.begin()+pos, _content.begin()+end);
-	else
-	   _content.erase(_content.begin()+pos, _content.end());
+	// Lines after the new end are blank now.
+	damageLines(pos, _content.getEndLine());
+	_content.deleteLines(pos, count);
 }
 
 void wxTerminalScreen::deleteLinesAtCarret(unsigned int count)
@@ -281,6 +2176,55 @@ void wxTerminalScreen::deleteLinesAtCarret(unsigned int count)
 	deleteLinesAbsolute(getCaretAbsolutePosition().y, count);
 }
 
+void wxTerminalScreen::setScrollMargins(int top, int bottom)
+{
+	if(top<0 || bottom>=_size.y || top>=bottom)
+	{
+		top = 0;
+		bottom = std::max(_size.y - 1, 0);
+	}
+	_scrollTop = top;
+	_scrollBottom = bottom;
+}
+
+void wxTerminalScreen::setHorizontalMargins(int left, int right)
+{
+	if(left<0 || right>=_size.x || left>=right)
+	{
+		left = 0;
+		right = std::max(_size.x - 1, 0);
+	}
+	_scrollLeft = left;
+	_scrollRight = right;
+}
+
+void wxTerminalScreen::scrollRows(int top, int bottom, int count)
+{
+	if(top<0 || top>bottom || count==0)
+		return;
+	size_t begin = top + getOriginLine(), end = bottom + 1 + getOriginLine();
+	if(hasHorizontalMargins())
+	{
+		for(size_t line=begin; line<end; ++line)
+			damageLine(line, _scrollLeft, _scrollRight + 1);
+		_content.scrollLines(begin, end, count, _scrollLeft, _scrollRight + 1);
+		return;
+	}
+	damageLines(begin, end);
+	_content.scrollLines(begin, end, count);
+}
+
+void wxTerminalScreen::scrollColumns(int top, int bottom, int left, int right, int count)
+{
+	if(top<0 || top>bottom || left<0 || left>right || count==0)
+		return;
+	for(size_t line=top + getOriginLine(), end=bottom + 1 + getOriginLine(); line<end; ++line)
+	{
+		damageLine(line, left, right + 1);
+		_content.scrollColumns(line, left, right + 1, count);
+	}
+}
+
 void wxTerminalScreen::moveCaret(int lines, int cols)
 {
 	_caretPosition.y += lines;
@@ -290,6 +2234,8 @@ void wxTerminalScreen::moveCaret(int lines, int cols)
 	{
 		while(_caretPosition.x >= _size.x)
 		{
+			// Soft wrap, the row continues on the next one.
+			_content.setWrapped(_caretPosition.y, true);
 			_caretPosition.x -= _size.x;
 			_caretPosition.y ++;
 		}
@@ -303,12 +2249,15 @@ void wxTerminalScreen::moveCaret(int lines, int cols)
 		}
 	}
 
-	// TODO Ensure caret is at a valid place in history (no underflow)
+	// Absolute lines are unsigned in the content, the caret cannot go above the first one.
+	if(_caretPosition.y < 0)
+		_caretPosition.y = 0;
 }
 
 void wxTerminalScreen::setCaretColumn(int col)
 {
-	wxTerminalLine& line = getLine(getCaretPosition().y);
+	// Moving the caret does not change the content shown.
+	wxTerminalLine& line = _content.getLine(_caretPosition.y);
 
 	if(line.size() == 0)
 		col = 0;
@@ -320,137 +2269,10 @@ void wxTerminalScreen::setCaretColumn(int col)
 
 void wxTerminalScreen::setCaretRow(int row)
 {
-	getChar(row, getCaretPosition().x);
+	_content.getLine(row + getOriginLine());
 	_caretPosition.y = row;
 }
 
-//
-//
-// wxTerminalCharacterDecoder
-//
-// Decode UTF-8 only at present day.
-//
-//
-wxTerminalCharacterDecoder::wxTerminalCharacterDecoder():
-_state(wxTCDSTATE_DEFAULT),
-_buffer(0)
-{
-}
-
-bool wxTerminalCharacterDecoder::add(unsigned char c, wxUniChar& ch)
-{
-	switch(_state)
-	{
-		case wxTCDSTATE_DEFAULT:
-		{
-			if( (c & 0x80) == 0 )  // UTF-8, first char == 0xxxxxxx
-			{
-				// Only one byte.
-				ch = wxUniChar(_buffer = (unsigned long)c);
-				return true;
-			}
-			else if( (c & 0xE0) == 0xC0 ) // UTF-8, first char = 110xxxxx
-			{
-				// Wait for two bytes.
-				_buffer = (c & 0x1F) << 6;
-				_state = wxTCDSTATE_UTF8_2BYTES;
-				return false;
-			}
-			else if( (c & 0xF0) == 0xE0 ) // UTF-8, first char = 1110xxxx
-			{
-				// Wait for two bytes.
-				_buffer = (c & 0x0F) << 12;
-				_state = wxTCDSTATE_UTF8_3BYTES_1;
-				return false;
-			}
-			else if( (c & 0xF8) == 0xF0 ) // UTF-8, first char = 11110xxx
-			{
-				// Wait for two bytes.
-				_buffer = (c & 0x07) << 18;
-				_state = wxTCDSTATE_UTF8_3BYTES_1;
-				return false;
-			}
-			else
-			{
-				// Bad encoding, reset !
-				ch = wxUniChar(_buffer = (unsigned long)c);
-				return true;
-			}
-			break;
-		}
-		case wxTCDSTATE_UTF8_2BYTES:
-		case wxTCDSTATE_UTF8_3BYTES_2:
-		case wxTCDSTATE_UTF8_4BYTES_3:
-		{
-			if( (c & 0xC0) == 0x80 )  // UTF-8, other char == 10xxxxxx
-			{
-				ch = wxUniChar( _buffer |= (unsigned long) (c & 0x3F) );
-				_state = wxTCDSTATE_DEFAULT;
-				return true;
-			}
-			else
-			{
-				// Bad encoding, reset !
-				// TODO WTF ?
-				_buffer = 0;
-				_state = wxTCDSTATE_DEFAULT;
-				return false;
-			}
-			break;
-		}
-		case wxTCDSTATE_UTF8_3BYTES_1:
-		case wxTCDSTATE_UTF8_4BYTES_2:
-		{
-			if( (c & 0xC0) == 0x80 )  // UTF-8, other char == 10xxxxxx
-			{
-				 _buffer |= (((unsigned long) (c & 0x3F)) << 6);
-				if(_state == wxTCDSTATE_UTF8_3BYTES_1)
-					_state = wxTCDSTATE_UTF8_3BYTES_2;
-				else
-					_state = wxTCDSTATE_UTF8_4BYTES_3;
-				return false;
-			}
-			else
-			{
-				// Bad encoding, reset !
-				// TODO WTF ?
-				_buffer = 0;
-				_state = wxTCDSTATE_DEFAULT;
-				return false;
-			}
-			break;
-		}
-		case wxTCDSTATE_UTF8_4BYTES_1:
-		{
-			if( (c & 0xC0) == 0x80 )  // UTF-8, other char == 10xxxxxx
-			{
-				 _buffer |= (((unsigned long) (c & 0x3F)) << 12);
-				_state = wxTCDSTATE_UTF8_4BYTES_2;
-				return false;
-			}
-			else
-			{
-				// Bad encoding, reset !
-				// TODO WTF ?
-				_buffer = 0;
-				_state = wxTCDSTATE_DEFAULT;
-				return false;
-			}
-			break;
-		}
-		default:
-		{
-			// Bad encoding, reset !
-			// TODO WTF ?
-			_buffer = 0;
-			_state = wxTCDSTATE_DEFAULT;
-			return false;
-		}
-		
-	}	
-	return false;
-}
-
 //
 //
 // wxTerminalCharacterMap
@@ -799,6 +2621,17 @@ const wxTerminalCharacterMap* wxTerminalCharacterMap::getMap(char id)
 	}
 }
 
+char wxTerminalCharacterMap::getId(const wxTerminalCharacterMap* map)
+{
+	static const char ids[] = "0AB4CRQKYEZH=";
+	for(const char* id=ids; *id!=0; ++id)
+	{
+		if(getMap(*id)==map)
+			return *id;
+	}
+	return 0;
+}
+
 //
 //
 // wxTerminalState
@@ -808,9 +2641,7 @@ const wxTerminalCharacterMap* wxTerminalCharacterMap::getMap(char id)
 wxTerminalState::wxTerminalState():
 cursorPos(0, 0)
 {
-	textAttributes.fore = 7;
-	textAttributes.back = 0;
-	textAttributes.style = wxTCS_Normal;
+	textAttributes = {7, 0, wxTCS_Normal};
 
 	Gx[0] = wxTerminalCharacterMap::getMap('B');
 	Gx[1] = wxTerminalCharacterMap::getMap('0');
@@ -827,9 +2658,7 @@ cursorPos(0, 0)
 wxTerminalState::wxTerminalState(const wxTerminalState& state):
 cursorPos(state.cursorPos)
 {
-	textAttributes.fore = state.textAttributes.fore;
-	textAttributes.back = state.textAttributes.back;
-	textAttributes.style = state.textAttributes.style;
+	textAttributes = state.textAttributes;
 
 	Gx[0] = state.Gx[0];
 	Gx[1] = state.Gx[1];
@@ -843,6 +2672,37 @@ cursorPos(state.cursorPos)
 	// TODO Set selection
 }
 
+void wxTerminalState::save(wxTerminalSessionWriter& out)const
+{
+	out.write<wxInt32>(cursorPos.x);
+	out.write<wxInt32>(cursorPos.y);
+	out.write(textAttributes);
+	for(size_t n=0; n<4; ++n)
+		out.write<char>(wxTerminalCharacterMap::getId(Gx[n]));
+	out.write<wxUint16>(GL);
+	out.write<wxUint16>(GR);
+}
+
+bool wxTerminalState::load(wxTerminalSessionReader& in)
+{
+	wxInt32 x, y;
+	char ids[4];
+	wxUint16 gl, gr;
+	if(!in.read(x) || !in.read(y) || !in.read(textAttributes) || !in.read(ids) || !in.read(gl) || !in.read(gr) || gl>3 || gr>3)
+		return false;
+	for(size_t n=0; n<4; ++n)
+	{
+		const wxTerminalCharacterMap* map = wxTerminalCharacterMap::getMap(ids[n]);
+		if(map==NULL)
+			return false;
+		Gx[n] = map;
+	}
+	cursorPos = wxPoint(x, y);
+	GL = gl;
+	GR = gr;
+	return true;
+}
+
 //
 //
 // wxTerminalCtrl
@@ -865,7 +2725,8 @@ wxWindow(parent, id, pos, size, style|wxVSCROLL/*|wxHSCROLL*/, name),
 m_connector(NULL),
 m_primaryScreen(NULL),
 m_alternateScreen(NULL),
-m_currentScreen(NULL)
+m_currentScreen(NULL),
+m_options(0)
 {
 	CommonInit();
 }
@@ -874,7 +2735,8 @@ wxTerminalCtrl::wxTerminalCtrl():
 m_connector(NULL),
 m_primaryScreen(NULL),
 m_alternateScreen(NULL),
-m_currentScreen(NULL)
+m_currentScreen(NULL),
+m_options(0)
 {
 }
 
@@ -896,10 +2758,14 @@ void wxTerminalCtrl::CommonInit()
 	// Initialize screens
 	m_primaryScreen = new wxTerminalScreen;
 	m_alternateScreen = new wxTerminalScreen;
+	m_alternateScreen->setReflow(false); // Full screen applications redraw on resize
+	m_primaryScreen->setHyperlinkTable(&m_hyperlinks);
+	m_alternateScreen->setHyperlinkTable(&m_hyperlinks);
 	m_currentScreen = m_primaryScreen; //  Default is primary ;)
 
 	// Default character set
-	m_charset = wxTCSET_UTF_8;
+	SetUTF8(true);
+	updateCharsetTable();
 
 	m_colours[0]  = wxColour(0, 0, 0); // Normal black
 	m_colours[1]  = wxColour(255, 85, 85); // Bright red
@@ -976,81 +2842,98 @@ void wxTerminalCtrl::send(char c)
 
 void wxTerminalCtrl::setWrapAround(bool val)
 {
-	m_options = (m_options & ~wxTOF_WRAPAROUND);
+	m_options = (m_options & ~(1 << wxTOF_WRAPAROUND));
 	if(val)
-		m_options |=  wxTOF_WRAPAROUND;
+		m_options |=  (1 << wxTOF_WRAPAROUND);
 }
 
 void wxTerminalCtrl::setReverseWrapAround(bool val)
 {
-	m_options = (m_options & ~wxTOF_REVERSE_WRAPAROUND);
+	m_options = (m_options & ~(1 << wxTOF_REVERSE_WRAPAROUND));
 	if(val)
-		m_options |=  wxTOF_REVERSE_WRAPAROUND;
+		m_options |=  (1 << wxTOF_REVERSE_WRAPAROUND);
 }
 
 void wxTerminalCtrl::setOriginMode(bool val)
 {
-	m_options = (m_options & ~wxTOF_ORIGINMODE);
+	m_options = (m_options & ~(1 << wxTOF_ORIGINMODE));
 	if(val)
-		m_options |=  wxTOF_ORIGINMODE;
+		m_options |=  (1 << wxTOF_ORIGINMODE);
 
-	// TODO
-	// setCursorPosition(0,0);
+	setCursorPosition(0,0);
 }
 
 void wxTerminalCtrl::setAutoCarriageReturn(bool val)
 {
-	m_options = (m_options & ~wxTOF_AUTO_CARRIAGE_RETURN);
+	m_options = (m_options & ~(1 << wxTOF_AUTO_CARRIAGE_RETURN));
 	if(val)
-		m_options |=  wxTOF_AUTO_CARRIAGE_RETURN;
+		m_options |=  (1 << wxTOF_AUTO_CARRIAGE_RETURN);
 }
 
 void wxTerminalCtrl::setCursorVisible(bool val)
 {
-	m_options = (m_options & ~wxTOF_CURSOR_VISIBLE);
+	m_options = (m_options & ~(1 << wxTOF_CURSOR_VISIBLE));
 	if(val)
-		m_options |=  wxTOF_CURSOR_VISIBLE;
+		m_options |=  (1 << wxTOF_CURSOR_VISIBLE);
 
 	// TODO
 }
 
 void wxTerminalCtrl::setCursorBlink(bool val)
 {
-	m_options = (m_options & ~wxTOF_CURSOR_BLINK);
+	m_options = (m_options & ~(1 << wxTOF_CURSOR_BLINK));
 	if(val)
-		m_options |=  wxTOF_CURSOR_BLINK;
+		m_options |=  (1 << wxTOF_CURSOR_BLINK);
 
 	// TODO
 }
 
 void wxTerminalCtrl::setInsertMode(bool val)
 {
-	m_options = (m_options & ~wxTOF_INSERT_MODE);
+	m_options = (m_options & ~(1 << wxTOF_INSERT_MODE));
 	if(val)
-		m_options |=  wxTOF_INSERT_MODE;
+		m_options |=  (1 << wxTOF_INSERT_MODE);
 }
 
 void wxTerminalCtrl::setReverseVideo(bool val)
 {
-	m_options = (m_options & ~wxTOF_REVERSE_VIDEO);
+	m_options = (m_options & ~(1 << wxTOF_REVERSE_VIDEO));
 	if(val)
-		m_options |=  wxTOF_REVERSE_VIDEO;
+		m_options |=  (1 << wxTOF_REVERSE_VIDEO);
 
 	// TODO
 }
 
 void wxTerminalCtrl::setApplicationCursor(bool val)
 {
-	m_options = (m_options & ~wxTOF_APPLICATION_CURSOR);
+	m_options = (m_options & ~(1 << wxTOF_APPLICATION_CURSOR));
 	if(val)
-		m_options |=  wxTOF_APPLICATION_CURSOR;
+		m_options |=  (1 << wxTOF_APPLICATION_CURSOR);
 }
 
 void wxTerminalCtrl::setApplicationKeypad(bool val)
 {
-	m_options = (m_options & ~wxTOF_APPLICATION_KEYPAD);
+	m_options = (m_options & ~(1 << wxTOF_APPLICATION_KEYPAD));
+	if(val)
+		m_options |=  (1 << wxTOF_APPLICATION_KEYPAD);
+}
+
+void wxTerminalCtrl::setLeftRightMarginMode(bool val)
+{
+	m_options = (m_options & ~(1 << wxTOF_LEFT_RIGHT_MARGIN));
+	if(val)
+		m_options |=  (1 << wxTOF_LEFT_RIGHT_MARGIN);
+
+	// Margins only apply while the mode is set.
+	if(!val)
+		m_currentScreen->setHorizontalMargins(0, m_currentScreen->getScreenSize().x - 1);
+}
+
+void wxTerminalCtrl::setRectangleExtent(bool val)
+{
+	m_options = (m_options & ~(1 << wxTOF_RECTANGLE_EXTENT));
 	if(val)
-		m_options |=  wxTOF_APPLICATION_KEYPAD;
+		m_options |=  (1 << wxTOF_RECTANGLE_EXTENT);
 }
 
 wxSize wxTerminalCtrl::GetCharSize(wxChar c)const
@@ -1067,12 +2950,81 @@ void wxTerminalCtrl::UpdateCaret()
 	m_caret->Move(sz.x*pos.x, sz.y*pos.y);
 }
 
+wxRect wxTerminalCtrl::GetRectangularArea(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right)const
+{
+	const wxTerminalScreen& screen = *m_currentScreen;
+	wxSize size = screen.getScreenSize();
+	int first = top>0 ? top-1 : 0, last = bottom>0 ? bottom-1 : size.y-1;
+	int firstCol = left>0 ? left-1 : 0, lastCol = right>0 ? right-1 : size.x-1;
+	if(getOriginMode())
+	{
+		first += screen.getScrollTop();
+		last = bottom>0 ? std::min(last + screen.getScrollTop(), screen.getScrollBottom()) : screen.getScrollBottom();
+		firstCol += screen.getScrollLeft();
+		lastCol = right>0 ? std::min(lastCol + screen.getScrollLeft(), screen.getScrollRight()) : screen.getScrollRight();
+	}
+	// Bounds past the screen edges are clamped to them.
+	last = std::min(last, size.y - 1);
+	lastCol = std::min(lastCol, size.x - 1);
+	return wxRect(firstCol, first, lastCol - firstCol + 1, last - first + 1);
+}
+
+void wxTerminalCtrl::ChangeAreaStyle(TerminalParserParams nbs, bool reverse)
+{
+	wxTerminalScreen& screen = *m_currentScreen;
+	wxRect area = GetRectangularArea(nbs[0], nbs[1], nbs[2], nbs[3]);
+	if(area.width<=0 || area.height<=0)
+		return;
+
+	// Attributes follow the corners, a missing one is 0 (all attributes).
+	const unsigned char all = wxTCS_Bold | wxTCS_Underlined | wxTCS_Blink | wxTCS_Inverse;
+	unsigned char clear = 0, set = 0, toggle = 0;
+	for(size_t n=4; n<std::max<size_t>(nbs.size(), 5); ++n)
+	{
+		unsigned char flag;
+		switch(nbs[n])
+		{
+		case 0:  flag = all; break;
+		case 1:  case 22: flag = wxTCS_Bold; break;
+		case 4:  case 24: flag = wxTCS_Underlined; break;
+		case 5:  case 25: flag = wxTCS_Blink; break;
+		case 7:  case 27: flag = wxTCS_Inverse; break;
+		default: continue;
+		}
+		if(reverse)
+		{
+			if(nbs[n]<20)
+				toggle |= flag;
+		}
+		else if(nbs[n]==0 || nbs[n]>=20)
+		{
+			clear |= flag;
+			set &= ~flag;
+		}
+		else
+		{
+			set |= flag;
+			clear &= ~flag;
+		}
+	}
+
+	// A stream goes from the first corner to the end of its row, then by whole rows up to the last corner.
+	if(getRectangleExtent() || area.height==1)
+		screen.changeRectangleStyle(area, clear, set, toggle);
+	else
+	{
+		int width = screen.getScreenSize().x, last = area.y + area.height - 1;
+		screen.changeRectangleStyle(wxRect(area.x, area.y, width - area.x, 1), clear, set, toggle);
+		screen.changeRectangleStyle(wxRect(0, area.y + 1, width, area.height - 2), clear, set, toggle);
+		screen.changeRectangleStyle(wxRect(0, last, area.x + area.width, 1), clear, set, toggle);
+	}
+}
+
 void wxTerminalCtrl::SetChar(wxUniChar c)
 {
 	if(getInsertMode())
-		m_currentScreen->insertChar(c, m_currentState.textAttributes);
-	else
-		m_currentScreen->overwriteChar(c, m_currentState.textAttributes);
+		m_currentScreen->insertBlanks(1);
+	m_currentScreen->overwriteChar(c, m_currentState.textAttributes);
 
 	// TODO add automatic scroll
 }
@@ -1080,7 +3032,26 @@ void wxTerminalCtrl::SetChar(wxUniChar c)
 void wxTerminalCtrl::newLine()
 {
 	m_currentScreen->setCaretColumn(0);
-	m_currentScreen->moveCaret(1, 0);
+	index();
+}
+
+void wxTerminalCtrl::index()
+{
+	// Without margins, the primary screen keeps the lines in history and the caret goes on.
+	wxTerminalScreen& screen = *m_currentScreen;
+	if(screen.getCaretPosition().y==screen.getScrollBottom() && (screen.hasScrollMargins() || screen.hasHorizontalMargins() || m_currentScreen==m_alternateScreen))
+		screen.scrollUp(1);
+	else
+		screen.moveCaret(1, 0);
+}
+
+void wxTerminalCtrl::reverseIndex()
+{
+	wxTerminalScreen& screen = *m_currentScreen;
+	if(screen.getCaretPosition().y==screen.getScrollTop())
+		screen.scrollDown(1);
+	else if(screen.getCaretPosition().y>0)
+		screen.moveCaret(-1, 0);
 }
 
 void wxTerminalCtrl::lineFeed()
@@ -1160,6 +3131,12 @@ void wxTerminalCtrl::setCursorRow(int row)
 
 void wxTerminalCtrl::setCursorPosition(int row, int col)
 {
+	// In origin mode, positions are counted from the top left of the scrolling region and stay in it.
+	if(getOriginMode())
+	{
+		row = std::min(row + m_currentScreen->getScrollTop(), m_currentScreen->getScrollBottom());
+		col = std::min(col + m_currentScreen->getScrollLeft(), m_currentScreen->getScrollRight());
+	}
 	m_currentScreen->setCaretPosition(wxPoint(col, row));
 }
 
@@ -1170,31 +3147,40 @@ void wxTerminalCtrl::eraseLeft()
 {
 	// NOTE probably remove characters instead of erasing them if line remaining is empty.
 	wxTerminalLine& line = m_currentScreen->getCurrentLine();
-	for(size_t col=0; col < m_currentScreen->getCaretAbsolutePosition().x; ++col)
+	size_t end = std::min<size_t>(m_currentScreen->getCaretAbsolutePosition().x, line.size());
+	for(size_t col=0; col < end; ++col)
 		line[col] = wxTerminalCharacter::DefaultCharacter;
 }
 
 void wxTerminalCtrl::eraseRight()
 {
-	m_currentScreen->getCurrentLine().resize(m_currentScreen->getCaretAbsolutePosition().x, wxTerminalCharacter::DefaultCharacter);
+	// Missing characters are already blank, do not create them.
+	size_t col = m_currentScreen->getCaretAbsolutePosition().x;
+	const wxTerminalScreen& screen = *m_currentScreen;
+	if(screen.getCurrentLine().size() > col)
+	{
+		// Rows keep the screen width, blanks are written in place.
+		wxTerminalLine& line = m_currentScreen->getCurrentLine();
+		std::fill(line.begin() + col, line.end(), wxTerminalCharacter::DefaultCharacter);
+	}
 }
 
 void wxTerminalCtrl::eraseLine()
 {
-	m_currentScreen->getCurrentLine().clear();
+	m_currentScreen->eraseLineAbsolute(m_currentScreen->getCaretAbsolutePosition().y);
 }
 
 void wxTerminalCtrl::eraseAbove()
 {
 	for(size_t row=0; row<m_currentScreen->getCaretPosition().y; ++row)
-		m_currentScreen->getLine(row).clear();
+		m_currentScreen->eraseLine(row);
 	eraseLeft();
 }
 
 void wxTerminalCtrl::eraseBelow()
 {
-	for(size_t row=m_currentScreen->getCaretPosition().y; row<m_consoleSize.y; ++row)
-		m_currentScreen->getLine(row).clear();
+	for(size_t row=m_currentScreen->getCaretPosition().y+1; row<m_consoleSize.y; ++row)
+		m_currentScreen->eraseLine(row);
 	eraseRight();
 }
 
@@ -1202,17 +3188,28 @@ void wxTerminalCtrl::eraseScreen()
 {
 	// TODO Should I scroll down instead of clear screen to keep screen in buffer ??
 	for(size_t row=0; row<m_consoleSize.y; ++row)
-		m_currentScreen->getLine(row).clear();
+		m_currentScreen->eraseLine(row);
 }
 
 void wxTerminalCtrl::insertLines(unsigned int count)
 {
-	m_currentScreen->insertLinesAtCarret(count);
+	// Lines pushed past the bottom of the scrolling region are lost, nothing happens outside of it.
+	wxTerminalScreen& screen = *m_currentScreen;
+	wxPoint pos = screen.getCaretPosition();
+	if(pos.y<screen.getScrollTop() || pos.y>screen.getScrollBottom() || pos.x<screen.getScrollLeft() || pos.x>screen.getScrollRight())
+		return;
+	screen.scrollRows(pos.y, screen.getScrollBottom(), -(int)count);
+	screen.setCaretColumn(screen.getScrollLeft());
 }
 
 void wxTerminalCtrl::deleteLines(unsigned int count)
 {
-	m_currentScreen->deleteLinesAtCarret(count);
+	wxTerminalScreen& screen = *m_currentScreen;
+	wxPoint pos = screen.getCaretPosition();
+	if(pos.y<screen.getScrollTop() || pos.y>screen.getScrollBottom() || pos.x<screen.getScrollLeft() || pos.x>screen.getScrollRight())
+		return;
+	screen.scrollRows(pos.y, screen.getScrollBottom(), count);
+	screen.setCaretColumn(screen.getScrollLeft());
 }
 
 
@@ -1333,6 +3330,9 @@ void wxTerminalCtrl::setDECMode(unsigned int mode, bool state)
 	case 45: // Reverse-wraparound Mode / No Reverse-wraparound Mode.
 		setReverseWrapAround(state);
 		break;
+	case 69: // Enable left and right margin mode (DECLRMM) / Disable left and right margin mode (DECLRMM).
+		setLeftRightMarginMode(state);
+		break;
 	case 47: // Use Alternate Screen Buffer / Use Normal Screen Buffer.
 	case 1047:
 		setAlternateMode(state);
@@ -1376,15 +3376,29 @@ void wxTerminalCtrl::restoreState()
 {
 	m_currentScreen->setCaretPosition(m_savedState.cursorPos);
 	m_currentState = m_savedState;
+	updateCharsetTable();
+}
+
+void wxTerminalCtrl::updateCharsetTable()
+{
+	const wxTerminalCharacterMap* gl = m_currentState.Gx[m_currentState.GL];
+	const wxTerminalCharacterMap* gr = m_currentState.Gx[m_currentState.GR];
+	m_charsetIdentity = gl==&wxTerminalCharacterMap::us && gr==&wxTerminalCharacterMap::us;
+	if(m_charsetIdentity)
+		return;
+	for(size_t n=0; n<0x80; ++n)
+		m_charsetTable[n] = (char32_t)gl->get(n).GetValue();
+	for(size_t n=0x80; n<0x100; ++n)
+		m_charsetTable[n] = (char32_t)gr->get(n).GetValue();
 }
 
 void wxTerminalCtrl::setAlternateMode(bool alternate)
 {
 	m_currentScreen = alternate ? m_alternateScreen : m_primaryScreen;
 
-	// TODO WTF when terminal size has changed ?
-
-	Refresh();
+	// Both screens follow the size of the control, see OnSize().
+	m_currentScreen->damageAll();
+	RefreshDamage();
 }
 
 
@@ -1397,51 +3411,55 @@ void wxTerminalCtrl::OnPaint(wxPaintEvent& event)
 	wxSize clientSz = GetClientSize();
 	wxSize clchSz = GetClientSizeInChars();
 
+	// Only the damaged part is drawn, see RefreshDamage().
+	wxRect box = GetUpdateRegion().GetBox();
+	if(box.IsEmpty())
+		box = wxRect(clientSz);
+	size_t firstRow = box.GetTop() / charSz.y, endRow = box.GetBottom() / charSz.y + 1;
+	size_t firstCol = box.GetLeft() / charSz.x, endCol = box.GetRight() / charSz.x + 1;
+
 	wxAutoBufferedPaintDC dc(this);
 	dc.SetBrush(wxBrush(*wxBLACK));
 	dc.SetPen(wxNullPen);
-	dc.DrawRectangle(0, 0, clientSz.x, clientSz.y);
+	dc.DrawRectangle(box);
 
-	for(size_t row=0; row<clchSz.y && row<m_currentScreen->getScreenRowCount(); row++)
+	// Read only access: history lines are not thawed nor created.
+	const wxTerminalScreen& screen = *m_currentScreen;
+	for(size_t row=firstRow; row<endRow && row<clchSz.y && row<screen.getScreenRowCount(); row++)
 	{
-		const wxTerminalLine& line = m_currentScreen->getLine(row);
-		for(size_t col=0; col<line.size(); col++)
+		const wxTerminalLine& line = screen.getLine(row);
+		for(size_t col=firstCol; col<endCol && col<line.size(); col++)
 		{
 			const wxTerminalCharacter &ch = line[col];
+			const wxTerminalCharacterAttributes& attr = m_currentScreen->getAttributes(ch);
 
 			// Invisible or not shown so skip
-			if(ch.c < 32 || ch.attr.style & wxTCS_Invisible)
+			if(ch.c < 32 || attr.style & wxTCS_Invisible)
 				continue;
 
 			// Choose font
-			if(ch.attr.style & wxTCS_Bold)
+			if(attr.style & wxTCS_Bold)
 			{
-				if(ch.attr.style & wxTCS_Underlined)
+				if(attr.style & wxTCS_Underlined)
 					dc.SetFont(m_boldUnderlineFont);
 				else
 					dc.SetFont(m_boldFont);
 			}
 			else
 			{
-				if(ch.attr.style & wxTCS_Underlined)
+				if(attr.style & wxTCS_Underlined)
 					dc.SetFont(m_underlineFont);
 				else
 					dc.SetFont(m_defaultFont);
 			}
 
 			// Choose colors
-			if(ch.attr.style & wxTCS_Inverse)
-			{
-				dc.SetBrush(wxBrush(m_colours[ch.attr.fore]));
-				dc.SetTextBackground(m_colours[ch.attr.fore]);
-				dc.SetTextForeground(m_colours[ch.attr.back]);
-			}
-			else
-			{
-				dc.SetBrush(wxBrush(m_colours[ch.attr.back]));
-				dc.SetTextBackground(m_colours[ch.attr.back]);
-				dc.SetTextForeground(m_colours[ch.attr.fore]);
-			}
+			wxColour fore = GetColour(attr.fore), back = GetColour(attr.back);
+			if(attr.style & wxTCS_Inverse)
+				std::swap(fore, back);
+			dc.SetBrush(wxBrush(back));
+			dc.SetTextBackground(back);
+			dc.SetTextForeground(fore);
 
 			// Draw
 			dc.DrawRectangle(col*charSz.x, row*charSz.y, charSz.x, charSz.y);
@@ -1450,17 +3468,38 @@ void wxTerminalCtrl::OnPaint(wxPaintEvent& event)
 	}
 }
 
+wxColour wxTerminalCtrl::GetColour(unsigned int color)const
+{
+	static const unsigned char levels[6] = {0, 95, 135, 175, 215, 255};
+	if(color & wxTERMINAL_COLOR_RGB)
+		return wxColour((color>>16) & 0xFF, (color>>8) & 0xFF, color & 0xFF);
+	else if(color<8)
+		return m_colours[color];
+	else if(color<16) // Bright colors, the base palette is already bright
+		return m_colours[color-8];
+	else if(color<232) // 6x6x6 color cube
+	{
+		color -= 16;
+		return wxColour(levels[color/36], levels[(color/6)%6], levels[color%6]);
+	}
+	else // Grayscale ramp
+	{
+		unsigned char level = 8 + (color-232)*10;
+		return wxColour(level, level, level);
+	}
+}
+
 void wxTerminalCtrl::OnScroll(wxScrollWinEvent& event)
 {
 	if(event.GetOrientation() == wxVERTICAL)
 	{
-		m_currentScreen->setOrigin(event.GetPosition());
+		m_currentScreen->setOrigin(m_currentScreen->getHistoryFirstRow() + event.GetPosition());
 	}
 
-	// Apply caret position (after scrolling)
-	UpdateCaret();
+	// Apply caret position (after scrolling), shown history may have been rewrapped.
+	UpdateScrollBars();
 
-	Refresh();
+	RefreshDamage();
 	event.Skip();
 }
 
@@ -1474,11 +3513,41 @@ void wxTerminalCtrl::OnSize(wxSizeEvent& event)
 	m_alternateScreen->setScreenSize(m_consoleSize);
 	
 	UpdateScrollBars();
+	RefreshDamage();
+}
+
+void wxTerminalCtrl::RefreshDamage()
+{
+	wxTerminalScreen& screen = *m_currentScreen;
+	wxSize charSz = GetCharSize();
+	int delta = screen.getScrollDelta();
+	if(screen.isAllDamaged() || std::abs(delta) >= m_consoleSize.y)
+	{
+		Refresh();
+		screen.clearDamage();
+		return;
+	}
+
+	// Shown lines moved: move their pixels, only the uncovered rows are redrawn.
+	if(delta!=0)
+		ScrollWindow(0, -delta * charSz.y);
+
+	size_t origin = screen.getOriginLine();
+	const std::vector<wxTerminalScreen::Damage>& lines = screen.getDamagedLines();
+	for(std::vector<wxTerminalScreen::Damage>::const_iterator it=std::lower_bound(lines.begin(), lines.end(), origin); it!=lines.end() && it->line<origin+m_consoleSize.y; ++it)
+	{
+		int begin = std::max(it->begin, 0), end = std::min(it->end, m_consoleSize.x);
+		if(begin < end)
+			RefreshRect(wxRect(begin * charSz.x, (it->line - origin) * charSz.y, (end - begin) * charSz.x, charSz.y), false);
+	}
+	screen.clearDamage();
 }
 
 void wxTerminalCtrl::UpdateScrollBars()
 {
-	SetScrollbar(wxVERTICAL, GetScrollPos(wxVERTICAL), m_consoleSize.y, m_currentScreen->getHistoryRowCount());
+	// Rewrapping the history may have moved the origin.
+	const wxTerminalScreen& screen = *m_currentScreen;
+	SetScrollbar(wxVERTICAL, screen.getOriginLine() - screen.getHistoryFirstRow(), m_consoleSize.y, screen.getHistoryRowCount());
 	UpdateCaret();
 }
 
@@ -1583,13 +3652,157 @@ void wxTerminalCtrl::append(const unsigned char* buff, size_t sz)
 {
 	if(buff && sz>0)
 	{
-		for(size_t n=0; n<sz; n++)
-		{
-			Process(buff[n]);
-		}
+		Process(buff, sz);
 		UpdateScrollBars();
-		Refresh();
+		RefreshDamage();
+	}
+}
+
+void wxTerminalCtrl::setScrollbackSize(size_t lines)
+{
+	m_primaryScreen->setHistoryMaxRowCount(lines);
+	UpdateScrollBars();
+}
+
+size_t wxTerminalCtrl::getScrollbackSize()const
+{
+	return m_primaryScreen->getHistoryMaxRowCount();
+}
+
+void wxTerminalCtrl::setScrollbackCompression(int level, size_t hotLines)
+{
+	m_primaryScreen->setHistoryCompression(level, hotLines);
+}
+
+/** Session file signature, followed by its version. */
+static const char s_sessionMagic[8] = {'w', 'x', 'T', 'e', 'r', 'm', 'S', 's'};
+static const wxUint32 s_sessionVersion = 1;
+
+bool wxTerminalCtrl::saveSession(const wxString& path)const
+{
+	wxFileOutputStream file(path);
+	if(!file.IsOk())
+		return false;
+	wxBufferedOutputStream buffered(file);
+	wxTerminalSessionWriter out(buffered);
+
+	out.write(s_sessionMagic, sizeof(s_sessionMagic));
+	out.write<wxUint32>(s_sessionVersion);
+	out.write<wxUint32>(m_options);
+	out.write<wxUint32>(m_tabWidth);
+	out.write<wxUint32>(m_tabstops.size());
+	for(std::set<unsigned int>::const_iterator it=m_tabstops.begin(); it!=m_tabstops.end(); ++it)
+		out.write<wxUint32>(*it);
+	m_currentState.save(out);
+	m_savedState.save(out);
+	out.write<wxUint8>(isPrimaryScreen() ? 0 : 1);
+	m_hyperlinks.save(out);
+	out.align();
+
+	m_primaryScreen->save(out);
+	m_alternateScreen->save(out);
+
+	buffered.Sync();
+	return out.isOk() && file.IsOk() && file.Close();
+}
+
+bool wxTerminalCtrl::loadSession(const wxString& path)
+{
+	bool ok = false;
+#ifdef __UNIX__
+	// Map the file, history blocks are copied from the mapping as they are.
+	int fd = ::open(path.fn_str(), O_RDONLY);
+	if(fd<0)
+		return false;
+	struct stat st;
+	void* map = MAP_FAILED;
+	if(::fstat(fd, &st)==0 && st.st_size>0)
+		map = ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(map==MAP_FAILED)
+		return false;
+	::madvise(map, st.st_size, MADV_SEQUENTIAL);
+	wxTerminalSessionReader in((const unsigned char*)map, st.st_size);
+	ok = LoadSession(in);
+	::munmap(map, st.st_size);
+#else
+	wxFile file(path);
+	if(!file.IsOpened() || file.Length()<=0)
+		return false;
+	std::vector<unsigned char> data(file.Length());
+	if(file.Read(&data[0], data.size())!=(ssize_t)data.size())
+		return false;
+	wxTerminalSessionReader in(&data[0], data.size());
+	ok = LoadSession(in);
+#endif
+	return ok;
+}
+
+bool wxTerminalCtrl::LoadSession(wxTerminalSessionReader& in)
+{
+	// Nothing is changed until the control settings are read.
+	char magic[sizeof(s_sessionMagic)];
+	wxUint32 version, options, tabWidth, tabCount;
+	if(!in.read(magic) || memcmp(magic, s_sessionMagic, sizeof(magic))!=0 || !in.read(version) || version!=s_sessionVersion
+			|| !in.read(options) || !in.read(tabWidth) || !in.read(tabCount))
+		return false;
+	std::set<unsigned int> tabstops;
+	for(wxUint32 n=0; n<tabCount; ++n)
+	{
+		wxUint32 col;
+		if(!in.read(col))
+			return false;
+		tabstops.insert(col);
+	}
+	wxTerminalState currentState, savedState;
+	wxUint8 alternate;
+	wxTerminalHyperlinkTable hyperlinks;
+	if(!currentState.load(in) || !savedState.load(in) || !in.read(alternate) || !hyperlinks.load(in) || !in.align())
+		return false;
+
+	// The attributes of the screens reference the hyperlinks, they are replaced first.
+	m_primaryScreen->clear();
+	m_alternateScreen->clear();
+	m_hyperlinks = std::move(hyperlinks);
+	bool ok = m_primaryScreen->load(in) && m_alternateScreen->load(in);
+	if(ok)
+	{
+		m_options = options;
+		m_tabWidth = tabWidth;
+		m_tabstops.swap(tabstops);
+		m_currentState = currentState;
+		m_savedState = savedState;
 	}
+	else
+	{
+		m_primaryScreen->clear();
+		m_alternateScreen->clear();
+		m_hyperlinks.clear();
+		m_currentState.textAttributes.hyperlink = 0;
+		m_savedState.textAttributes.hyperlink = 0;
+		alternate = 0;
+	}
+
+	// The window size wins over the saved one.
+	m_primaryScreen->setScreenSize(m_consoleSize);
+	m_alternateScreen->setScreenSize(m_consoleSize);
+	updateCharsetTable();
+	setAlternateMode(alternate!=0);
+	UpdateScrollBars();
+	return ok;
+}
+
+bool wxTerminalCtrl::setScrollbackSpill(size_t maxBytes, const wxString& path)
+{
+	return m_primaryScreen->setHistorySpill(maxBytes, path);
+}
+
+wxTerminalMemoryStatistics wxTerminalCtrl::getMemoryStatistics()const
+{
+	wxTerminalMemoryStatistics stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	m_primaryScreen->addStatistics(stats);
+	m_alternateScreen->addStatistics(stats);
+	return stats;
 }
 
 
@@ -1598,21 +3811,33 @@ void wxTerminalCtrl::append(const unsigned char* buff, size_t sz)
 //
 
 
-void wxTerminalCtrl::onPrintableChar(unsigned char c)
+void wxTerminalCtrl::onPrintableText(TerminalParserText text)
 {
-	switch(m_charset)
+	wxTerminalScreen& screen = *m_currentScreen;
+	for(size_t n=0; n<text.size(); )
 	{
-		case wxTCSET_ISO_8859_1:
-			SetChar(c);
-			break;
-		case wxTCSET_UTF_8:
+		// In insert mode, the characters written up to the end of the row (or up to the left margin)
+		// are inserted at once: the row is shifted a single time then they are written over the blanks.
+		size_t end = text.size();
+		if(getInsertMode())
+		{
+			int col = screen.getCaretPosition().x;
+			int last = col<screen.getScrollLeft() ? screen.getScrollLeft() - 1 : screen.getRowEnd(col);
+			end = std::min<size_t>(end, n + std::max(last + 1 - col, 1));
+			screen.insertBlanks(end - n);
+		}
+		if(m_charsetIdentity)
 		{
-			wxUniChar ch;
-			if(m_mbdecoder.add(c, ch))
+			for(; n<end; ++n)
+				screen.overwriteChar(wxUniChar((unsigned long)text[n]), m_currentState.textAttributes);
+		}
+		else
+		{
+			for(; n<end; ++n)
 			{
-				SetChar(ch);
+				char32_t c = text[n];
+				screen.overwriteChar(wxUniChar((unsigned long)(c<0x100 ? m_charsetTable[c] : c)), m_currentState.textAttributes);
 			}
-			break;
 		}
 	}
 }
@@ -1620,13 +3845,13 @@ void wxTerminalCtrl::onPrintableChar(unsigned char c)
 void wxTerminalCtrl::onS7C1T() // 7-bit controls
 {
 	TRACE("S7C1T");
-	// Note: no trapping 7 and 8 bits modes as they are always recognized for now
+	// Note: 8-bit controls recognition is switched by the parser
 }
 
 void wxTerminalCtrl::onS8C1T() // 8-bit controls
 {
 	TRACE("S8C1T");
-	// Note: no trapping 7 and 8 bits modes as they are always recognized for now
+	// Note: 8-bit controls recognition is switched by the parser
 }
 
 void wxTerminalCtrl::onANSIconf1() // Set ANSI conformance level 1  (vt100, 7-bit controls).
@@ -1671,12 +3896,14 @@ void wxTerminalCtrl::onDECALN() // DEC Screen Alignment Test
 
 void wxTerminalCtrl::onISO8859_1() // Select default character set. That is ISO 8859-1 (ISO 2022).
 {
-	NOT_IMPLEMENTED("ISO8859_1");
+	TRACE("ISO8859_1");
+	// Note: input decoding is switched by the parser
 }
 
 void wxTerminalCtrl::onUTF_8() // Select UTF-8 character set (ISO 2022).
 {
-	NOT_IMPLEMENTED("UTF_8");
+	TRACE("UTF_8");
+	// Note: input decoding is switched by the parser
 }
 
 // Character Set Selection (SCS). Designate G(id) (G0...G3) Character Set (ISO 2022)
@@ -1687,6 +3914,7 @@ void wxTerminalCtrl::onSCS(unsigned char id, unsigned char charset)
 		m_currentState.Gx[id] = wxTerminalCharacterMap::getMap(charset);
 	if(m_currentState.Gx[id]==NULL)
 		m_currentState.Gx[id] = &wxTerminalCharacterMap::us;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onDECBI() // Back Index, VT420 and up.
@@ -1732,30 +3960,35 @@ void wxTerminalCtrl::onLS2() // Invoke the G2 Character Set as GL.
 {
 	TRACE("LS2");
 	m_currentState.GL = 2;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onLS3() // Invoke the G3 Character Set as GL.
 {
 	TRACE("LS3");
 	m_currentState.GL = 3;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onLS1R() // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
 {
 	TRACE("LS1R");
 	m_currentState.GR = 1;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onLS2R() // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
 {
 	TRACE("LS2R");
 	m_currentState.GR = 2;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onLS3R() // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
 {
 	TRACE("LS3R");
 	m_currentState.GR = 3;
+	updateCharsetTable();
 }
 
 
@@ -1819,7 +4052,6 @@ void wxTerminalCtrl::onHT()   // 0x09
 void wxTerminalCtrl::onLF()   // 0x0A - LINE FEED
 {
 	TRACE("LF");
-	SetChar(0x0A);
 	formFeed(); // Do form feed (instead of line feed) processing accordingly with autoCarriageReturn
 }
 
@@ -1847,6 +4079,7 @@ void wxTerminalCtrl::onSO()   // 0x0E
 	// Shift Out (SO), aka Lock Shift 0 (LS1).
 	// Invoke G1 character set in GL.
 	m_currentState.GL = 1;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onSI()   // 0x0F
@@ -1855,6 +4088,7 @@ void wxTerminalCtrl::onSI()   // 0x0F
     // Shift In (SI), aka Lock Shift 0 (LS0).
     // Invoke G0 character set in GL.
 	m_currentState.GL = 0;
+	updateCharsetTable();
 }
 
 void wxTerminalCtrl::onDLE()  // 0x10
@@ -1947,12 +4181,14 @@ void wxTerminalCtrl::onNBH()  // 0x83
 
 void wxTerminalCtrl::onIND()  // 0x84
 {
-	NOT_IMPLEMENTED("IND");
+	TRACE("IND");
+	index();
 }
 
 void wxTerminalCtrl::onNEL()  // 0x85
 {
-	NOT_IMPLEMENTED("NEL");
+	TRACE("NEL");
+	newLine();
 }
 
 void wxTerminalCtrl::onSSA()  // 0x86
@@ -1993,7 +4229,8 @@ void wxTerminalCtrl::onPLU()  // 0x8C
 
 void wxTerminalCtrl::onRI()   // 0x8D
 {
-	NOT_IMPLEMENTED("RI");
+	TRACE("RI");
+	reverseIndex();
 }
 
 void wxTerminalCtrl::onSS2()  // 0x8E
@@ -2056,7 +4293,8 @@ void wxTerminalCtrl::onSCI()  // 0x9A
 //-----	
 void wxTerminalCtrl::onICH(unsigned short nb) // Insert P s (Blank) Character(s) (default = 1)
 {
-	NOT_IMPLEMENTED("ICH " << nb);
+	TRACE("ICH " << nb);
+	m_currentScreen->insertBlanks(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onCUU(unsigned short nb) // Cursor Up P s Times (default = 1)
@@ -2181,33 +4419,37 @@ void wxTerminalCtrl::onDECSEL(unsigned short nb)  // Erase in Line. 0 → Select
 void wxTerminalCtrl::onIL(unsigned short nb)  // Insert Ps Line(s) (default = 1)
 {
 	TRACE("IL " << nb);
-	insertLines(nb);
+	insertLines(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onDL(unsigned short nb)  // Delete Ps Line(s) (default = 1)
 {
 	TRACE("DL " << nb);
-	deleteLines(nb);
+	deleteLines(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onDCH(unsigned short nb) // Delete Ps Character(s) (default = 1)
 {
-	NOT_IMPLEMENTED("DCH " << nb);
+	TRACE("DCH " << nb);
+	m_currentScreen->deleteCells(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onSU(unsigned short nb)  // Scroll up Ps lines (default = 1)
 {
-	NOT_IMPLEMENTED("SU " << nb);
+	TRACE("SU " << nb);
+	m_currentScreen->scrollUp(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onSD(unsigned short nb)  // Scroll down Ps lines (default = 1)
 {
-	NOT_IMPLEMENTED("SD " << nb);
+	TRACE("SD " << nb);
+	m_currentScreen->scrollDown(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onECH(unsigned short nb)  // Erase Ps Character(s) (default = 1)
 {
-	NOT_IMPLEMENTED("ECH " << nb);
+	TRACE("ECH " << nb);
+	m_currentScreen->eraseCells(std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onCBT(unsigned short nb)  // Cursor Backward Tabulation Ps tab stops (default = 1)
@@ -2219,7 +4461,7 @@ void wxTerminalCtrl::onCBT(unsigned short nb)  // Cursor Backward Tabulation Ps
 	}
 }
 
-void wxTerminalCtrl::onHPA(const std::vector<unsigned short> nbs)  // Character Position Absolute [column] (default = [row,1]) (HPA).
+void wxTerminalCtrl::onHPA(TerminalParserParams nbs)  // Character Position Absolute [column] (default = [row,1]) (HPA).
 {
 	NOT_IMPLEMENTED("HPA");
 /*	std::cout << "onHPA";
@@ -2228,7 +4470,7 @@ void wxTerminalCtrl::onHPA(const std::vector<unsigned short> nbs)  // Character
 	std::cout << std::endl;*/
 }
 
-void wxTerminalCtrl::onHPR(const std::vector<unsigned short> nbs)  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
+void wxTerminalCtrl::onHPR(TerminalParserParams nbs)  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
 {
 	NOT_IMPLEMENTED("HPR");
 /*	std::cout << "onHPR";
@@ -2237,14 +4479,14 @@ void wxTerminalCtrl::onHPR(const std::vector<unsigned short> nbs)  // Character
 	std::cout << std::endl;*/
 }
 
-void wxTerminalCtrl::onVPA(const std::vector<unsigned short> nbs)  // Line Position Absolute [row] (default = [1,column])
+void wxTerminalCtrl::onVPA(TerminalParserParams nbs)  // Line Position Absolute [row] (default = [1,column])
 {
 	TRACE("VPA");
 	if(nbs.size()>0)
 		setCursorRow(nbs[0]-1);
 }
 
-void wxTerminalCtrl::onVPR(const std::vector<unsigned short> nbs)  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
+void wxTerminalCtrl::onVPR(TerminalParserParams nbs)  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
 {
 	NOT_IMPLEMENTED("VPR");
 /*	std::cout << "onVPR";
@@ -2267,21 +4509,21 @@ void wxTerminalCtrl::onTBC(unsigned short nb)  // Tab Clear
 		clearAllTabStops();
 }
 
-void wxTerminalCtrl::onSM(const std::vector<unsigned short> nbs)  // Set Mode
+void wxTerminalCtrl::onSM(TerminalParserParams nbs)  // Set Mode
 {
 	TRACE("SM");
 	for(size_t n=0; n<nbs.size(); ++n)
 		setANSIMode(nbs[n], true);
 }
 
-void wxTerminalCtrl::onDECSET(const std::vector<unsigned short> nbs)  // DEC Private Mode Set
+void wxTerminalCtrl::onDECSET(TerminalParserParams nbs)  // DEC Private Mode Set
 {
 	TRACE("DECSET");
 	for(size_t n=0; n<nbs.size(); ++n)
 		setDECMode(nbs[n], true);
 }
 
-void wxTerminalCtrl::onMC(const std::vector<unsigned short> nbs)  // Media Copy
+void wxTerminalCtrl::onMC(TerminalParserParams nbs)  // Media Copy
 {
 	NOT_IMPLEMENTED("MC");
 /*	std::cout << "onMC";
@@ -2290,7 +4532,7 @@ void wxTerminalCtrl::onMC(const std::vector<unsigned short> nbs)  // Media Copy
 	std::cout << std::endl;*/
 }
 
-void wxTerminalCtrl::onDECMC(const std::vector<unsigned short> nbs)  // DEC specific Media Copy
+void wxTerminalCtrl::onDECMC(TerminalParserParams nbs)  // DEC specific Media Copy
 {
 	NOT_IMPLEMENTED("DECMC");
 /*	std::cout << "onDECMC";
@@ -2299,14 +4541,14 @@ void wxTerminalCtrl::onDECMC(const std::vector<unsigned short> nbs)  // DEC spec
 	std::cout << std::endl;*/
 }
 
-void wxTerminalCtrl::onRM(const std::vector<unsigned short> nbs)  // Reset Mode
+void wxTerminalCtrl::onRM(TerminalParserParams nbs)  // Reset Mode
 {
 	TRACE("RM");
 	for(size_t n=0; n<nbs.size(); ++n)
 		setANSIMode(nbs[n], false);
 }
 
-void wxTerminalCtrl::onDECRST(const std::vector<unsigned short> nbs)  // DEC Private Mode Reset
+void wxTerminalCtrl::onDECRST(TerminalParserParams nbs)  // DEC Private Mode Reset
 {
 	TRACE("DECRST");
 	for(size_t n=0; n<nbs.size(); ++n)
@@ -2334,22 +4576,36 @@ void wxTerminalCtrl::onDSR(unsigned short nb)  // Device Status Report
 	}
 }
 
-void wxTerminalCtrl::onSGR(const std::vector<unsigned short> nbs) // Select Graphic Renditions -- In progress
+void wxTerminalCtrl::onSGR(TerminalParserParams nbs) // Select Graphic Renditions -- In progress
 {
 	TRACE("SGR");
-	for(size_t n=0; n<nbs.size(); ++n)
+	size_t next;
+	for(size_t n=0; n<nbs.size(); n=next)
 	{
+		// Parameter group: the parameter and its colon-separated sub-parameters.
+		size_t group = nbs.groupSize(n);
+		next = n + group;
 		unsigned short sgr = nbs[n]; 
 		switch(sgr)
 		{
-		case 0: // Default
+		case 0: // Default, hyperlink is kept as it is not a graphic rendition
+		{
+			unsigned short hyperlink = m_currentState.textAttributes.hyperlink;
 			m_currentState.textAttributes = {7, 0, wxTCS_Normal};
+			m_currentState.textAttributes.hyperlink = hyperlink;
 			break;
+		}
 		case 1: // Bold
 			m_currentState.textAttributes.style |= wxTCS_Bold;
 			break;
-		case 4: // Underline
-			m_currentState.textAttributes.style |= wxTCS_Underlined;
+		case 4: // Underline, "4:0" is no underline, "4:1" to "4:5" are single, double, curly, dotted and dashed
+			if(group>1 && nbs[n+1]==0)
+				m_currentState.textAttributes.style &= ~wxTCS_Underlined;
+			else
+			{
+				m_currentState.textAttributes.style |= wxTCS_Underlined;
+				m_currentState.textAttributes.underline = (group>1 && nbs[n+1]<=5) ? nbs[n+1]-1 : wxTUS_Single;
+			}
 			break;
 		case 5: // Blink
 			m_currentState.textAttributes.style |= wxTCS_Blink;
@@ -2360,6 +4616,10 @@ void wxTerminalCtrl::onSGR(const std::vector<unsigned short> nbs) // Select Grap
 		case 8: // Invisible (hidden)
 			m_currentState.textAttributes.style |= wxTCS_Invisible;
 			break;
+		case 21: // Doubly underlined
+			m_currentState.textAttributes.style |= wxTCS_Underlined;
+			m_currentState.textAttributes.underline = wxTUS_Double;
+			break;
 		case 22: // Normal (neither bold nor faint)
 			m_currentState.textAttributes.style &= ~wxTCS_Bold;
 			break;
@@ -2385,6 +4645,36 @@ void wxTerminalCtrl::onSGR(const std::vector<unsigned short> nbs) // Select Grap
 		case 37: // Foreground white
 			m_currentState.textAttributes.fore = sgr - 30;
 			break;
+		case 38: // Foreground extended color
+		case 48: // Background extended color
+		{
+			// Forms are "38:5:I", "38:2:[CS]:R:G:B" and legacy "38;5;I", "38;2;R;G;B".
+			long color = -1;
+			if(nbs[n+1]==5)
+			{
+				color = std::min<unsigned short>(nbs[n+2], 255);
+				if(group==1)
+					next = n + 3;
+			}
+			else if(nbs[n+1]==2)
+			{
+				size_t rgb = (group>=6) ? n+3 : n+2; // Skip color space id if any.
+				color = wxTERMINAL_COLOR_RGB
+						| (std::min<unsigned short>(nbs[rgb], 255) << 16)
+						| (std::min<unsigned short>(nbs[rgb+1], 255) << 8)
+						| std::min<unsigned short>(nbs[rgb+2], 255);
+				if(group==1)
+					next = n + 5;
+			}
+			if(color>=0)
+			{
+				if(sgr==38)
+					m_currentState.textAttributes.fore = color;
+				else
+					m_currentState.textAttributes.back = color;
+			}
+			break;
+		}
 		case 39: // Foreground default
 			m_currentState.textAttributes.fore = 7;
 			break;
@@ -2486,10 +4776,16 @@ void wxTerminalCtrl::onDECSCA(unsigned short nb)  // Select character protection
 
 void wxTerminalCtrl::onDECSTBM(unsigned short top, unsigned short bottom) // Set Scrolling Region [top;bottom] (default = full size of window)
 {
-	NOT_IMPLEMENTED("DECSTBM top=" << top << " bottom=" << bottom);
+	TRACE("DECSTBM top=" << top << " bottom=" << bottom);
+	int rows = m_consoleSize.y;
+	int first = top>0 ? top-1 : 0, last = bottom>0 ? std::min<int>(bottom, rows) - 1 : rows - 1;
+	if(first >= last)
+		return;
+	m_currentScreen->setScrollMargins(first, last);
+	setCursorPosition(0, 0);
 }
 
-void wxTerminalCtrl::onRDECPMV(const std::vector<unsigned short> nbs)  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
+void wxTerminalCtrl::onRDECPMV(TerminalParserParams nbs)  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
 {
 	NOT_IMPLEMENTED("RDECPMV");
 /*	std::cout << "onRDECPMV";
@@ -2498,7 +4794,7 @@ void wxTerminalCtrl::onRDECPMV(const std::vector<unsigned short> nbs)  // Restor
 	std::cout << std::endl;*/
 }
 
-void wxTerminalCtrl::onSDECPMV(const std::vector<unsigned short> nbs)  // Save DEC Private Mode Values. P s values are the same as for DECSET.
+void wxTerminalCtrl::onSDECPMV(TerminalParserParams nbs)  // Save DEC Private Mode Values. P s values are the same as for DECSET.
 {
 	NOT_IMPLEMENTED("SDECPMV");
 /*	std::cout << "onSDECPMV";
@@ -2507,28 +4803,37 @@ void wxTerminalCtrl::onSDECPMV(const std::vector<unsigned short> nbs)  // Save D
 	std::cout << std::endl;*/
 }
 
-void wxTerminalCtrl::onDECCARA(const std::vector<unsigned short> nbs)  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
+void wxTerminalCtrl::onDECCARA(TerminalParserParams nbs)  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
 {
-	NOT_IMPLEMENTED("DECCARA");
-/*	std::cout << "onDECCARA";
-	for(size_t n=0; n<nbs.size(); ++n)
-		std::cout << " " << nbs[n];
-	std::cout << std::endl;*/
+	TRACE("DECCARA");
+	ChangeAreaStyle(nbs, false);
 }
 
 void wxTerminalCtrl::onDECSLRM(unsigned short left, unsigned short right) // Set left and right margins (DECSLRM), available only when DECLRMM is enabled (VT420 and up).
 {
-	NOT_IMPLEMENTED("DECSLRM left=" << left << " right=" << right);
+	TRACE("DECSLRM left=" << left << " right=" << right);
+	if(!getLeftRightMarginMode())
+		return;
+	int cols = m_consoleSize.x;
+	int first = left>0 ? left-1 : 0, last = right>0 ? std::min<int>(right, cols) - 1 : cols - 1;
+	if(first >= last)
+		return;
+	m_currentScreen->setHorizontalMargins(first, last);
+	setCursorPosition(0, 0);
 }
 
 void wxTerminalCtrl::onANSISC()  // Save cursor (ANSI.SYS), available only when DECLRMM is disabled.
 {
-	NOT_IMPLEMENTED("ANSISC");
+	// With left and right margins enabled, a bare CSI s resets them (DECSLRM without parameters).
+	if(getLeftRightMarginMode())
+		onDECSLRM(0, 0);
+	else
+		saveState();
 }
 
 void wxTerminalCtrl::onANSIRC()  // Restore cursor (ANSI.SYS).
 {
-	NOT_IMPLEMENTED("ANSIRC");
+	restoreState();
 }
 
 void wxTerminalCtrl::onWindowManip(unsigned short nb1, unsigned short nb2, unsigned short nb3) // Set conformance level
@@ -2536,13 +4841,10 @@ void wxTerminalCtrl::onWindowManip(unsigned short nb1, unsigned short nb2, unsig
 	NOT_IMPLEMENTED("WindowManip " << nb1 << " " << nb2 << " " << nb3);
 }
 
-void wxTerminalCtrl::onDECRARA(const std::vector<unsigned short> nbs)  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
+void wxTerminalCtrl::onDECRARA(TerminalParserParams nbs)  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
 {
-	NOT_IMPLEMENTED("DECRARA");
-/*	std::cout << "onDECRARA";
-	for(size_t n=0; n<nbs.size(); ++n)
-		std::cout << " " << nbs[n];
-	std::cout << std::endl;*/
+	TRACE("DECRARA");
+	ChangeAreaStyle(nbs, true);
 }
 
 void wxTerminalCtrl::onDECSWBV(unsigned short nb)  // Set warning-bell volume (DECSWBV, VT520).
@@ -2555,13 +4857,13 @@ void wxTerminalCtrl::onDECSMBV(unsigned short nb)  // Set margin-bell volume (DE
 	NOT_IMPLEMENTED("DECSMBV " << nb);
 }
 
-void wxTerminalCtrl::onDECCRA(const std::vector<unsigned short> nbs)  // Copy Rectangular Area (DECCRA, VT400 and up).
+void wxTerminalCtrl::onDECCRA(TerminalParserParams nbs)  // Copy Rectangular Area (DECCRA, VT400 and up).
 {
-	NOT_IMPLEMENTED("DECCRA");
-/*	std::cout << "onDECCRA";
-	for(size_t n=0; n<nbs.size(); ++n)
-		std::cout << " " << nbs[n];
-	std::cout << std::endl;*/
+	// Source rectangle, source page, destination top-left corner and page, there is a single page.
+	TRACE("DECCRA");
+	wxRect area = GetRectangularArea(nbs[0], nbs[1], nbs[2], nbs[3]);
+	wxRect dest = GetRectangularArea(nbs[5], nbs[6], 0, 0);
+	m_currentScreen->copyRectangle(area, wxPoint(dest.x, dest.y));
 }
 
 void wxTerminalCtrl::onDECEFR(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right) // Enable Filter Rectangle (DECEFR), VT420 and up.
@@ -2576,12 +4878,19 @@ void wxTerminalCtrl::onDECREQTPARM(unsigned short nb)  // Request Terminal Param
 
 void wxTerminalCtrl::onDECSACE(unsigned short nb)  // Select Attribute Change Extent
 {
-	NOT_IMPLEMENTED("DECSACE " << nb);
+	TRACE("DECSACE " << nb);
+	setRectangleExtent(nb==2);
 }
 
 void wxTerminalCtrl::onDECFRA(unsigned short chr, unsigned short top, unsigned short left, unsigned short bottom, unsigned short right) // Fill Rectangular Area (DECFRA), VT420 and up.
 {
-	NOT_IMPLEMENTED("DECFRA " << chr << " " << top << " " << left << " " << bottom << " " << right);
+	TRACE("DECFRA " << chr << " " << top << " " << left << " " << bottom << " " << right);
+	// Only printable characters of GL and GR can be used.
+	if(chr<32 || chr==127 || (chr>127 && chr<160) || chr>255)
+		return;
+	// The character is mapped by the designated charsets as if printed (e.g. DEC Special Graphics).
+	char32_t c = m_charsetIdentity ? chr : m_charsetTable[chr];
+	m_currentScreen->fillRectangle(GetRectangularArea(top, left, bottom, right), wxUniChar((unsigned long)c), m_currentState.textAttributes);
 }
 
 void wxTerminalCtrl::onDECRQCRA(unsigned short id, unsigned short page, unsigned short top, unsigned short left, unsigned short bottom, unsigned short right) // Request Checksum of Rectangular Area (DECRQCRA), VT420 and up.
@@ -2596,10 +4905,11 @@ void wxTerminalCtrl::onDECELR(unsigned short nb1, unsigned short nb2) // Enable
 
 void wxTerminalCtrl::onDECERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right) // Erase Rectangular Area (DECERA), VT400 and up.
 {
-	NOT_IMPLEMENTED("DECERA " << top << " " << left << " " << bottom << " " << right);
+	TRACE("DECERA " << top << " " << left << " " << bottom << " " << right);
+	m_currentScreen->fillRectangle(GetRectangularArea(top, left, bottom, right), wxTerminalCharacter::DefaultCharacter);
 }
 
-void wxTerminalCtrl::onDECSLE(const std::vector<unsigned short> nbs)  // Select Locator Events (DECSLE).
+void wxTerminalCtrl::onDECSLE(TerminalParserParams nbs)  // Select Locator Events (DECSLE).
 {
 	NOT_IMPLEMENTED("DECSLE");
 /*	std::cout << "onDECSLE";
@@ -2610,7 +4920,9 @@ void wxTerminalCtrl::onDECSLE(const std::vector<unsigned short> nbs)  // Select
 
 void wxTerminalCtrl::onDECSERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right) // Selective Erase Rectangular Area (), VT400 and up.
 {
-	NOT_IMPLEMENTED("DECSERA " << top << " " << left << " " << bottom << " " << right);
+	// Characters cannot be protected yet (DECSCA), all of them are erased.
+	TRACE("DECSERA " << top << " " << left << " " << bottom << " " << right);
+	m_currentScreen->fillRectangle(GetRectangularArea(top, left, bottom, right), wxTerminalCharacter::DefaultCharacter);
 }
 
 void wxTerminalCtrl::onDECRQLP(unsigned short nb)  // Request Locator Position (DECRQLP).
@@ -2620,12 +4932,23 @@ void wxTerminalCtrl::onDECRQLP(unsigned short nb)  // Request Locator Position (
 
 void wxTerminalCtrl::onDECIC(unsigned short nb)  // Insert P s Column(s) (default = 1) (DECIC), VT420 and up.
 {
-	NOT_IMPLEMENTED("DECIC " << nb);
+	// Columns from the caret to the right margin move right in the scrolling region, those pushed past it are lost.
+	TRACE("DECIC " << nb);
+	wxTerminalScreen& screen = *m_currentScreen;
+	wxPoint pos = screen.getCaretPosition();
+	if(pos.y<screen.getScrollTop() || pos.y>screen.getScrollBottom() || pos.x<screen.getScrollLeft() || pos.x>screen.getScrollRight())
+		return;
+	screen.scrollColumns(screen.getScrollTop(), screen.getScrollBottom(), pos.x, screen.getScrollRight(), -(int)std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onDECDC(unsigned short nb)  // InsDelete P s Column(s) (default = 1) (DECIC), VT420 and up.
 {
-	NOT_IMPLEMENTED("onDECDC " << nb);
+	TRACE("DECDC " << nb);
+	wxTerminalScreen& screen = *m_currentScreen;
+	wxPoint pos = screen.getCaretPosition();
+	if(pos.y<screen.getScrollTop() || pos.y>screen.getScrollBottom() || pos.x<screen.getScrollLeft() || pos.x>screen.getScrollRight())
+		return;
+	screen.scrollColumns(screen.getScrollTop(), screen.getScrollBottom(), pos.x, screen.getScrollRight(), std::max<unsigned short>(nb, 1));
 }
 
 void wxTerminalCtrl::onOSC(unsigned short command, const std::vector<unsigned char>& params) // Receive an OSC (Operating System Command) command. -- In progress
@@ -2639,6 +4962,19 @@ void wxTerminalCtrl::onOSC(unsigned short command, const std::vector<unsigned ch
 			std::cout << "Change window title : " << str << std::endl;
 			break;
 		}
+		case 8: // Hyperlink, Pt is "params;URI", an empty URI ends the link.
+		{
+			std::vector<unsigned char>::const_iterator sep = std::find(params.begin(), params.end(), ';');
+			size_t start = sep - params.begin() + 1;
+			m_currentState.textAttributes.hyperlink = 0;
+			if(start < params.size())
+			{
+				// Longer URIs or too many of them end up without link.
+				wxString uri((const char*)&params[start], params.size() - start);
+				m_currentState.textAttributes.hyperlink = m_hyperlinks.intern(uri, m_savedState.textAttributes.hyperlink);
+			}
+			break;
+		}
 		default:
 			// TODO Add others
 			NOT_IMPLEMENTED("OSC command=" << command);
@@ -22,7 +22,11 @@
 
 #include <vector>
 #include <list>
+#include <deque>
 #include <set>
+#include <climits>
+#include <unordered_map>
+#include <algorithm>
 
 #include "terminal-parser.hpp"
 
@@ -32,6 +36,7 @@ struct wxTerminalCharacter;
 class wxTerminalContent;
 class wxTerminalCtrl;
 class wxTerminalConnector;
+class wxOutputStream;
 
 /**
  * Character presentational style.
@@ -49,24 +54,50 @@ enum wxTerminalCharacterStyle
 	//wxTCS_Selected   = 128 // wxTerminal specific
 };
 
+/**
+ * Underline style, when wxTCS_Underlined is set (SGR "4:x").
+ */
+enum wxTerminalUnderlineStyle
+{
+	wxTUS_Single = 0,
+	wxTUS_Double,
+	wxTUS_Curly,
+	wxTUS_Dotted,
+	wxTUS_Dashed
+};
+
+/**
+ * Color flag: the color is a 24-bit 0xRRGGBB value instead of a 256-color palette index.
+ */
+#define wxTERMINAL_COLOR_RGB 0x01000000
+
 /**
  * Character presentational attributes.
  */
 struct wxTerminalCharacterAttributes
 {
-	unsigned char fore;
-	unsigned char back;
+	unsigned int fore; // Palette index or wxTERMINAL_COLOR_RGB value
+	unsigned int back; // Palette index or wxTERMINAL_COLOR_RGB value
 	unsigned char style; // From wxTerminalCharacterStyle
+	unsigned char underline; // From wxTerminalUnderlineStyle
+	unsigned short hyperlink; // Hyperlink id (OSC 8), 0 if none
+
+	bool operator==(const wxTerminalCharacterAttributes& attr)const
+	{
+		return fore==attr.fore && back==attr.back && style==attr.style && underline==attr.underline && hyperlink==attr.hyperlink;
+	}
+	bool operator!=(const wxTerminalCharacterAttributes& attr)const{return !(*this==attr);}
 };
 
 /**
  * Represent a terminal character:
- * an unicode character with its presentational attributes.
+ * an unicode character with the index of its presentational attributes
+ * in the attribute table of its screen.
  */
 struct wxTerminalCharacter
 {
 	wxUniChar c;
-	wxTerminalCharacterAttributes attr;
+	unsigned short attr;
 
 	static wxTerminalCharacter DefaultCharacter;
 };
@@ -76,15 +107,266 @@ struct wxTerminalCharacter
  */
 typedef std::vector<wxTerminalCharacter> wxTerminalLine;
 
+/**
+ * Compact form of a line which is not shown anymore and is unlikely to change:
+ * dense code points with run-length encoded attribute indexes.
+ * Typical lines have only one or two attribute runs.
+ * Code points are stored on 8, 16 or 32 bits, the narrowest fitting all of them.
+ */
+class wxTerminalFrozenLine
+{
+public:
+	wxTerminalFrozenLine():_data(NULL), _runCount(0), _shift(0), _length(0), _wrapped(0){}
+	wxTerminalFrozenLine(const wxTerminalFrozenLine& line);
+	wxTerminalFrozenLine(wxTerminalFrozenLine&& line) noexcept;
+	~wxTerminalFrozenLine(){delete[] _data;}
+	wxTerminalFrozenLine& operator=(wxTerminalFrozenLine line){swap(line); return *this;}
+
+	/** Exchange content with another frozen line. */
+	void swap(wxTerminalFrozenLine& line) noexcept;
+
+	/** Test if there is no frozen content. */
+	bool empty()const{return _length==0;}
+	/** Number of characters. */
+	size_t size()const{return _length;}
+	/** Size of code points, in bytes (1, 2 or 4). */
+	size_t getWidth()const{return 1 << _shift;}
+	/** Allocated size, in bytes. */
+	size_t getMemorySize()const{return getDataSize() * sizeof(unsigned int);}
+
+	/** Replace the frozen content by a line. */
+	void freeze(const wxTerminalLine& line);
+	/** Expand the frozen content to a line. */
+	void thaw(wxTerminalLine& line)const;
+	/** Release the frozen content, the wrap flag is kept. */
+	void clear(){delete[] _data; _data = NULL; _runCount = 0; _shift = 0; _length = 0;}
+
+	/** Check if the line continues on the next one (soft wrap). */
+	bool isWrapped()const{return _wrapped!=0;}
+	/** Mark the line as continuing on the next one or not.
+	 * The flag is kept here whether the line is frozen or not. */
+	void setWrapped(bool wrapped){_wrapped = wrapped ? 1 : 0;}
+
+	/** Append the frozen content to a buffer. */
+	void save(std::vector<unsigned int>& buffer)const;
+	/** Restore the frozen content from a buffer filled by save().
+	 * @return Position following the restored content. */
+	const unsigned int* load(const unsigned int* buffer);
+	/** Restore the frozen content from a buffer filled by save(), not reading past end.
+	 * @return Position following the restored content, NULL if it does not fit. */
+	const unsigned int* load(const unsigned int* buffer, const unsigned int* end);
+
+protected:
+	enum { MAX_RUN_LENGTH = 0xFFFF };
+
+	/** Number of words of data. */
+	size_t getDataSize()const{return _runCount + (((size_t)_length << _shift) + 3) / 4;}
+
+	/** Attribute runs as (index << 16 | length), followed by code points, in one allocation.
+	 * Not a vector to keep slots of the content small. */
+	unsigned int* _data;
+	/** Number of attribute runs. */
+	unsigned int _runCount:30;
+	/** Code point size, as a power of two of bytes. */
+	unsigned int _shift:2;
+	/** Number of characters. */
+	unsigned int _length:31;
+	/** Soft wrap flag, saved in the high bit of the length. */
+	unsigned int _wrapped:1;
+};
+
+
+/**
+ * Memory usage of terminal content.
+ */
+struct wxTerminalMemoryStatistics
+{
+	/** Number of stored lines. */
+	size_t lines;
+	/** Number of lines stored as characters (active area or modified). */
+	size_t cellLines;
+	/** Number of frozen lines, by code point size: 8, 16 and 32 bits. */
+	size_t frozen8Lines, frozen16Lines, frozen32Lines;
+	/** Number of lines in compressed blocks. */
+	size_t compressedLines;
+	/** Number of lines spilled to disk, and bytes used in the spill file. */
+	size_t spilledLines, spillBytes;
+	/** Bytes allocated for lines: slots, characters and frozen data. */
+	size_t bytes;
+	/** Number of attribute table entries. */
+	size_t attributes;
+};
+
+/**
+ * Disk tier of the scrollback: compressed blocks evicted from memory are
+ * appended to a file mapped in memory and read back from the mapping.
+ * The file is used as a circular buffer bounded by a maximum size,
+ * the oldest blocks are overwritten when it is full.
+ * Blocks are numbered like the content ones, the index gives the place
+ * of each block in the file.
+ * Only available on Unix, open() fails elsewhere.
+ */
+class wxTerminalSpillFile
+{
+public:
+	wxTerminalSpillFile();
+	~wxTerminalSpillFile();
+
+	wxTerminalSpillFile(const wxTerminalSpillFile&) = delete;
+	wxTerminalSpillFile& operator=(const wxTerminalSpillFile&) = delete;
+
+	/**
+	 * Create the file and map it.
+	 * A temporary file is created if the path is empty.
+	 * The file only backs the current history, it is truncated on open and removed on close.
+	 */
+	bool open(const wxString& path, size_t maxBytes);
+	/** Unmap and close the file, removing it. */
+	void close();
+	/** Check if the file is opened. */
+	bool isOpened()const{return _map!=NULL;}
+
+	/** Append a compressed block, overwriting the oldest ones if needed. */
+	void append(size_t block, const unsigned char* data, size_t size, size_t words);
+	/** Retrieve the compressed data of a block, NULL if it is not stored. */
+	const unsigned char* get(size_t block, size_t& size, size_t& words)const;
+	/** Forget all blocks. */
+	void clear();
+
+	/** Number of the first stored block. */
+	size_t getFirstBlock()const{return _firstBlock;}
+	/** Number following the last stored block. */
+	size_t getEndBlock()const{return _firstBlock + _index.size();}
+	/** Number of blocks really stored (not skipped). */
+	size_t getBlockCount()const;
+	/** Number of bytes used by stored blocks. */
+	size_t getUsedBytes()const;
+	/** Retrieve the file path. */
+	const wxString& getPath()const{return _path;}
+
+protected:
+	/** Place of a block in the file, size is 0 if the block is not stored. */
+	struct Entry
+	{
+		size_t offset;
+		size_t size;
+		size_t words;
+	};
+
+	/** Entries of blocks from _firstBlock. */
+	std::deque<Entry> _index;
+	size_t _firstBlock;
+	/** Offset of the next block. */
+	size_t _writePos;
+	/** Maximum size of the file. */
+	size_t _maxBytes;
+	wxString _path;
+	int _fd;
+	unsigned char* _map;
+};
+
+/**
+ * Writer of a session file (see wxTerminalCtrl::saveSession).
+ * Values are written in native byte order, blocks of words are aligned on 4 bytes
+ * so they can be used in place from the mapped file.
+ */
+class wxTerminalSessionWriter
+{
+public:
+	wxTerminalSessionWriter(wxOutputStream& out):_out(out), _position(0), _ok(true){}
+
+	/** Write raw bytes. */
+	void write(const void* data, size_t size);
+	/** Write a value of fixed size. */
+	template<typename T> void write(const T& value){write(&value, sizeof(T));}
+	/** Write a string as its UTF-8 length and bytes. */
+	void write(const wxString& str);
+	/** Write character attributes field by field. */
+	void write(const wxTerminalCharacterAttributes& attr);
+	/** Pad to the next multiple of 4 bytes. */
+	void align();
+
+	/** Check if all writes succeeded. */
+	bool isOk()const{return _ok;}
+
+protected:
+	wxOutputStream& _out;
+	size_t _position;
+	bool _ok;
+};
+
+/**
+ * Reader of a session file mapped in memory, never reading past its end.
+ */
+class wxTerminalSessionReader
+{
+public:
+	wxTerminalSessionReader(const unsigned char* data, size_t size):_begin(data), _data(data), _end(data + size){}
+
+	/** Read raw bytes, return false if not enough data. */
+	bool read(void* data, size_t size);
+	/** Read a value of fixed size. */
+	template<typename T> bool read(T& value){return read(&value, sizeof(T));}
+	/** Read a string written by wxTerminalSessionWriter. */
+	bool read(wxString& str);
+	/** Read character attributes written by wxTerminalSessionWriter. */
+	bool read(wxTerminalCharacterAttributes& attr);
+	/** Retrieve the next bytes in place and skip them, NULL if not enough data. */
+	const unsigned char* skip(size_t size);
+	/** Skip the padding to the next multiple of 4 bytes. */
+	bool align();
+
+	/** Retrieve the next bytes in place without skipping them. */
+	const unsigned char* getData()const{return _data;}
+	/** Number of bytes left. */
+	size_t getRemaining()const{return _end - _data;}
+
+protected:
+	const unsigned char *_begin, *_data, *_end;
+};
+
 /**
  * Represent the content of a terminal.
- * It is a vector of terminal lines withoutknowledge of scrolling.
+ * It is a circular store of terminal lines without knowledge of scrolling.
+ * Lines are addressed by absolute numbers which stay valid while they are
+ * kept: when the maximum number of lines is reached, adding a line recycles
+ * the oldest one and increments the first line number.
+ * Lines older than the active area (the last rows, addressable by the
+ * screen) are frozen and transparently thawed if accessed for modification.
+ * Lines older than the hot window are compressed by blocks of BLOCK_LINES,
+ * read accesses uncompress them in a small cache of blocks.
+ * If a spill file is set, blocks are compressed before their lines are
+ * recycled and moved to the file once dropped, they stay readable (but
+ * not modifiable) from there, the first line is then the oldest spilled one.
  * It just verify that the slots are available.
  * It doesnt do any character validation.
  */
-class wxTerminalContent: public std::vector<wxTerminalLine>
+class wxTerminalContent
 {
 public:
+	enum
+	{
+		DEFAULT_MAX_LINES = 10000,
+		DEFAULT_HOT_LINES = 1024,
+		DEFAULT_COMPRESSION_LEVEL = 1,
+		BLOCK_LINES = 256,
+		CACHED_BLOCKS = 4,
+		/** Limits of the values read from a session, beyond them it is considered corrupted. */
+		MAX_SESSION_LINES = 0x10000000,
+		MAX_LINE_LENGTH = 0x10000,
+		/** Words of a block whose lines are all MAX_LINE_LENGTH long, as many runs as characters. */
+		MAX_BLOCK_WORDS = BLOCK_LINES * (2 + 2 * MAX_LINE_LENGTH)
+	};
+
+	/** Shared blank line, returned by const accesses to lines not stored. */
+	static const wxTerminalLine BlankLine;
+
+	wxTerminalContent(size_t maxLines = DEFAULT_MAX_LINES);
+	~wxTerminalContent();
+
+	wxTerminalContent(const wxTerminalContent&) = delete;
+	wxTerminalContent& operator=(const wxTerminalContent&) = delete;
+
 	/**
 	 * Set a char at the specified position.
 	 */
@@ -96,12 +378,13 @@ public:
 	void insertChar(wxPoint pos, wxTerminalCharacter c);
 
 	/**
-	 * Add an empty new line
+	 * Add an empty new line, dropping the oldest one if the store is full.
 	 */
 	void addNewLine();
 
 	/**
 	 * Retrieve reference to a specified line, ensuring it exists, creating it if needed.
+	 * Lines already dropped from history are not addressable anymore, a blank scratch line is returned for them.
 	 */
 	wxTerminalLine& getLine(size_t line);
 
@@ -109,6 +392,367 @@ public:
 	 * Retrieve a reference to a specified character, ensuring it exists, creating it if needed.
 	 */
 	wxTerminalCharacter& getChar(size_t line, size_t col);
+
+	/**
+	 * Retrieve a line without creating it.
+	 * A blank scratch line is returned if it is not stored.
+	 * A frozen line is thawed by the non-const version, the const version
+	 * expands it in a scratch line valid up to the next call.
+	 */
+	wxTerminalLine& operator[](size_t line);
+	const wxTerminalLine& operator[](size_t line)const;
+
+	/**
+	 * Make a line blank.
+	 * Lines not stored are already blank, frozen lines are released without being thawed.
+	 * A line of the active area keeps its capacity for the characters written next,
+	 * other ones release their memory.
+	 */
+	void eraseLine(size_t line);
+
+	/** Insert blank lines before the specified line, following lines are moved down. */
+	void insertLines(size_t line, size_t count);
+	/** Remove lines from the specified line, following lines are moved up. */
+	void deleteLines(size_t line, size_t count);
+	/**
+	 * Move the lines from begin to end (excluded) up by count lines, down if count is negative.
+	 * Lines moved out at one end come back blank at the other end,
+	 * only the slots are moved, characters are not copied.
+	 */
+	void scrollLines(size_t begin, size_t end, int count);
+	/**
+	 * Move the characters from column left to right (excluded) of the lines from begin to end (excluded)
+	 * up by count lines, down if count is negative. Characters out of these columns stay in place,
+	 * the spans are copied from line to line and the ones moved in at one end are blank.
+	 */
+	void scrollLines(size_t begin, size_t end, int count, size_t left, size_t right);
+	/**
+	 * Move the characters of a line from column left to right (excluded) to the left by count columns,
+	 * to the right if count is negative. The span is moved in place, the columns moved in are blank.
+	 */
+	void scrollColumns(size_t line, size_t left, size_t right, int count);
+	/**
+	 * Make the characters of a line from column left to right (excluded) blank.
+	 * Missing characters are already blank and are not created.
+	 */
+	void eraseColumns(size_t line, size_t left, size_t right);
+
+	/** Remove all lines and restart numbering from 0. */
+	void clear();
+
+	/** Absolute number of the oldest readable line, including compressed or spilled ones already dropped from the ring. */
+	size_t getFirstLine()const;
+	/** Absolute number following the last stored line. */
+	size_t getEndLine()const{return _first + _count;}
+	/** Number of readable lines. */
+	size_t size()const{return getEndLine() - getFirstLine();}
+
+	/** Retrieve the number of last lines kept as characters. */
+	size_t getActiveLines()const{return _active;}
+	/** Change the number of last lines kept as characters, older lines are frozen when new ones are added. */
+	void setActiveLines(size_t lines){_active = lines;}
+	/** Retrieve the width of the rows of the active area. */
+	size_t getActiveWidth()const{return _width;}
+	/** Change the width of the rows of the active area.
+	 * Active rows are filled with blanks up to this width when written, so characters
+	 * are written in place, trailing blanks are trimmed when they are frozen.
+	 * Stored lines keep their wrapping until rewrapped by reflow(). */
+	void setActiveWidth(size_t cols);
+
+	/** Retrieve the first line known to be wrapped at the active width. */
+	size_t getReflowedLine()const{return std::min(_reflowed, getEndLine());}
+	/**
+	 * Rewrap the lines from a line up to the ones already rewrapped at the active width.
+	 * Whole logical lines are rewrapped, following the soft wrap flags.
+	 * At least as many lines as already done are rewrapped, so going up
+	 * the whole history costs a linear time overall.
+	 * Lines dropped from the ring cannot be changed and keep their wrapping.
+	 * @param positions Absolute positions to move with the characters, following lines
+	 * are moved too when the number of lines changes.
+	 */
+	void reflow(size_t line, wxPoint* positions, size_t count);
+
+	/** Check if a line continues on the next one (soft wrap). */
+	bool isWrapped(size_t line)const;
+	/** Mark a line as continuing on the next one or not. */
+	void setWrapped(size_t line, bool wrapped);
+
+	/** Freeze a line to its compact form. */
+	void freeze(size_t line);
+
+	/** Add the memory usage of stored lines to statistics. */
+	void addStatistics(wxTerminalMemoryStatistics& stats)const;
+
+	/** Retrieve the zlib compression level of cold blocks, 0 if disabled. */
+	int getCompressionLevel()const{return _compressionLevel;}
+	/** Change the zlib compression level (1...9) of next cold blocks, 0 to disable compression. */
+	void setCompressionLevel(int level){_compressionLevel = level;}
+	/** Retrieve the number of last lines never compressed. */
+	size_t getHotLines()const{return _hot;}
+	/** Change the number of last lines never compressed. */
+	void setHotLines(size_t lines){_hot = lines;}
+
+	/** Retrieve the maximum number of stored lines. */
+	size_t getMaxLines()const{return _max;}
+	/** Change the maximum number of stored lines, dropping the oldest ones if needed. */
+	void setMaxLines(size_t maxLines);
+
+	/**
+	 * Spill the dropped blocks to a file of at most maxBytes, 0 to disable.
+	 * A temporary file is used if the path is empty, it is removed when
+	 * disabled or destroyed.
+	 * Return false if the file cannot be created.
+	 */
+	bool setSpill(size_t maxBytes, const wxString& path = wxEmptyString);
+	/** Retrieve the spill file, NULL if disabled. */
+	const wxTerminalSpillFile* getSpill()const{return _spill;}
+
+	/**
+	 * Write the lines and settings to a session.
+	 * Compressed and spilled blocks are written as is, other lines frozen.
+	 */
+	void save(wxTerminalSessionWriter& out)const;
+	/**
+	 * Replace the content by the one of a session.
+	 * Blocks older than the ring go to the spill file if any, they are dropped otherwise.
+	 * The spill file is kept, other settings are restored.
+	 * @return false if the session is malformed, the content is then cleared.
+	 */
+	bool load(wxTerminalSessionReader& in);
+
+protected:
+	/** Slot of a stored line in the ring. */
+	size_t slot(size_t line)const
+	{
+		size_t s = _start + (line - _first);
+		return s < _lines.size() ? s : s - _lines.size();
+	}
+
+	/** Line slot, holding either the characters or the frozen form of a line. */
+	struct Slot
+	{
+		wxTerminalLine line;
+		wxTerminalFrozenLine frozen;
+
+		void clear(){line.clear(); frozen.clear(); frozen.setWrapped(false);}
+	};
+
+	/** Retrieve the characters of a stored line, uncompressing and thawing it if needed. */
+	wxTerminalLine& thaw(size_t line);
+
+	/** Rewrap the logical lines from begin to end at the active width, see reflow().
+	 * begin is moved to the start of its logical line.
+	 * @return The new end. */
+	size_t rewrap(size_t& begin, size_t end, wxPoint* positions, size_t count);
+
+	/** Block of cold lines, compressed together. */
+	struct Block
+	{
+		/** Compressed frozen lines, empty if the lines are back in their slots. */
+		std::vector<unsigned char> data;
+		/** Uncompressed size, in words. */
+		size_t size;
+	};
+
+	/** Uncompressed lines of a block. */
+	struct CachedBlock
+	{
+		size_t index;
+		std::vector<wxTerminalFrozenLine> lines;
+	};
+
+	/** Retrieve the compressed block of a line, NULL if the line is in its slot. */
+	const Block* getBlock(size_t line)const;
+	/** Compress the lines of a block and release their slots. */
+	void compress(size_t block, int level);
+	/** Retrieve the compressed data of a block, in memory or spilled, NULL if not stored. */
+	const unsigned char* getBlockData(size_t block, size_t& size, size_t& words)const;
+	/** Retrieve the lines of a compressed block, uncompressing them in the cache if needed. */
+	const std::vector<wxTerminalFrozenLine>& uncompress(size_t block)const;
+	/** Move the lines of a compressed block back to their slots. */
+	void expand(size_t block);
+	/** Expand the compressed blocks from a line to the end. */
+	void expandFrom(size_t line);
+	/** Release the blocks whose lines are all dropped, moving them to the spill file if any. */
+	void dropBlocks();
+
+	/** Line slots, grown up to _max then used as a ring. */
+	std::vector<Slot> _lines;
+	/** Slot of the first line. */
+	size_t _start;
+	/** Absolute number of the first line. */
+	size_t _first;
+	/** Number of stored lines. */
+	size_t _count;
+	/** Maximum number of stored lines. */
+	size_t _max;
+	/** Number of last lines never frozen. */
+	size_t _active;
+	/** Width of the rows of the active area. */
+	size_t _width;
+	/** Characters of the last frozen row, reused by the next row written. */
+	wxTerminalLine _spare;
+	/** First line wrapped at the active width, older ones are rewrapped when shown. */
+	size_t _reflowed;
+	/** Number of last lines never compressed. */
+	size_t _hot;
+	/** Compression level, 0 if disabled. */
+	int _compressionLevel;
+
+	/** Compressed blocks, from block _firstBlock (lines _firstBlock*BLOCK_LINES and following). */
+	std::deque<Block> _blocks;
+	size_t _firstBlock;
+	/** Recently uncompressed blocks, most recent first. */
+	mutable std::list<CachedBlock> _cache;
+	/** Disk tier of dropped blocks, NULL if disabled. */
+	wxTerminalSpillFile* _spill;
+	/** Scratch line returned for lines out of the store or decoded from their compact form. */
+	mutable wxTerminalLine _outside;
+};
+
+
+/**
+ * Table of the hyperlink URIs (OSC 8) of a terminal, shared by its screens.
+ * Attribute entries keep a 16-bit id, each live entry holds a reference on it.
+ * Ids no longer referenced are reused for new URIs, their URI is kept until
+ * then so a link still open in the terminal state remains valid.
+ */
+class wxTerminalHyperlinkTable
+{
+public:
+	enum
+	{
+		MAX_IDS = 0xFFFF,
+		/** Longest URI accepted, as VTE does. */
+		MAX_URI_LENGTH = 2083,
+		/** Characters of URIs kept at most, URIs of unreferenced ids are dropped first. */
+		MAX_TOTAL_LENGTH = 4 * 1024 * 1024
+	};
+
+	wxTerminalHyperlinkTable();
+
+	/** Retrieve the URI of an id, empty if unknown. */
+	wxString get(unsigned short id)const{return id>0 && id<=_entries.size() ? _entries[id-1].uri : wxString();}
+	/** Number of ids, used or not: ids are up to it. */
+	size_t getCount()const{return _entries.size();}
+	/** Number of characters of the kept URIs. */
+	size_t getTotalLength()const{return _length;}
+
+	/** Retrieve the id of a URI, adding it if needed.
+	 * A kept id (of the saved terminal state) is not reused, even if unreferenced.
+	 * @return 0 if the URI is too long or no id is available. */
+	unsigned short intern(const wxString& uri, unsigned short kept);
+
+	/** Add a reference on an id. */
+	void retain(unsigned short id);
+	/** Remove a reference from an id, it is reused once no longer referenced. */
+	void release(unsigned short id);
+
+	/** Forget all URIs. */
+	void clear();
+
+	/** Write the URIs to a session. */
+	void save(wxTerminalSessionWriter& out)const;
+	/** Replace the URIs by the ones of a session, unreferenced.
+	 * @return false if the session is malformed, the table is then cleared. */
+	bool load(wxTerminalSessionReader& in);
+
+protected:
+	struct Entry
+	{
+		wxString uri;
+		/** Number of attribute entries referencing the id. */
+		size_t refs;
+		/** Set while the id is unreferenced, it is then in the free list. */
+		bool free;
+	};
+
+	/** Forget the URI of an unreferenced id. */
+	void drop(unsigned short id);
+
+	/** Entries of ids, id n is at n-1. */
+	std::vector<Entry> _entries;
+	/** Unreferenced ids, some may have been referenced again since (see Entry::free). */
+	std::vector<unsigned short> _free;
+	std::unordered_map<wxString, unsigned short, wxStringHash> _ids;
+	/** Characters of the kept URIs. */
+	size_t _length;
+};
+
+
+/**
+ * Table of the attributes used by the characters of a screen.
+ * Equal attributes share one entry so characters only keep a 16-bit index.
+ * Entry 0 holds the attributes of wxTerminalCharacter::DefaultCharacter.
+ * References are counted by scanning the content when the table is full,
+ * entries no longer used are then released and reused.
+ */
+class wxTerminalAttributeTable
+{
+public:
+	enum
+	{
+		DEFAULT_INDEX = 0,
+		MAX_ENTRIES = 65536,
+		/** A collect releasing fewer entries is not repeated before COLLECT_DELAY_LINES new lines or COLLECT_DELAY_MISSES missing attributes. */
+		MIN_COLLECTED = MAX_ENTRIES / 64,
+		COLLECT_DELAY_LINES = 1024,
+		COLLECT_DELAY_MISSES = 4096
+	};
+
+	wxTerminalAttributeTable();
+
+	/** Retrieve the attributes of an index. */
+	const wxTerminalCharacterAttributes& get(unsigned short index)const{return _entries[index];}
+
+	/** Retrieve the index of attributes, adding them if needed.
+	 * @return DEFAULT_INDEX if the table is full. */
+	unsigned short intern(const wxTerminalCharacterAttributes& attr);
+
+	/** Test if all the entries are used. */
+	bool full()const{return _free.empty() && _entries.size()>=MAX_ENTRIES;}
+	/** Number of used entries. */
+	size_t size()const{return _entries.size() - _free.size();}
+	/** Number of entries, used or released: indexes are below it. */
+	size_t getEntryCount()const{return _entries.size();}
+
+	/** Retrieve the index of existing attributes close to some attributes:
+	 * without their hyperlink, then their colours, else the last interned ones. */
+	unsigned short nearest(const wxTerminalCharacterAttributes& attr)const;
+
+	/** Count the references from a content and release unreferenced entries.
+	 * @return Number of released entries. */
+	size_t collect(const wxTerminalContent& content);
+
+	/** Release all entries but the default one. */
+	void clear();
+
+	/** Set the table of the hyperlinks referenced by entries, NULL if none. */
+	void setHyperlinkTable(wxTerminalHyperlinkTable* hyperlinks);
+
+	/** Write the entries to a session. */
+	void save(wxTerminalSessionWriter& out)const;
+	/** Replace the entries by the ones of a session.
+	 * @return false if the session is malformed, the table is then cleared. */
+	bool load(wxTerminalSessionReader& in);
+
+protected:
+	struct Hash
+	{
+		size_t operator()(const wxTerminalCharacterAttributes& attr)const
+		{
+			return (attr.fore * 31 + attr.back) * 31 + ((attr.style<<24) | (attr.underline<<16) | attr.hyperlink);
+		}
+	};
+
+	std::vector<wxTerminalCharacterAttributes> _entries;
+	std::vector<unsigned short> _free;
+	std::unordered_map<wxTerminalCharacterAttributes, unsigned short, Hash> _indexes;
+
+	/** Last interned entry, most characters are written with the same attributes as the previous one. */
+	unsigned short _last;
+	/** Hyperlinks referenced by live entries, NULL if not counted. */
+	wxTerminalHyperlinkTable* _hyperlinks;
 };
 
 
@@ -124,14 +768,21 @@ public:
 	/** Clear the screen (and buffer). */
 	void clear();
 
-	/** Retrieve a line, from its screen position.*/
-	wxTerminalLine& getLine(int line){ _content.getLine(line+_originPosition.y); }
-	wxTerminalLine& operator[](int line){ _content.getLine(line+_originPosition.y); }
-	const wxTerminalLine& getLine(int line)const{ return _content[line+_originPosition.y]; }
-	const wxTerminalLine& operator[](int line)const{ return _content[line+_originPosition.y]; }
+	/** Write the content, attributes, origin, caret and size to a session. */
+	void save(wxTerminalSessionWriter& out)const;
+	/** Restore the screen from a session.
+	 * @return false if the session is malformed, the screen is then cleared. */
+	bool load(wxTerminalSessionReader& in);
+
+	/** Retrieve a line, from its screen position.
+	 * Non-const accesses mark the line as damaged. */
+	wxTerminalLine& getLine(int line){ damageLine(line+getOriginLine()); return _content.getLine(line+getOriginLine()); }
+	wxTerminalLine& operator[](int line){ return getLine(line); }
+	const wxTerminalLine& getLine(int line)const{ return _content[line+getOriginLine()]; }
+	const wxTerminalLine& operator[](int line)const{ return _content[line+getOriginLine()]; }
 
 	/** Retrieve a line, from its absolute position.*/
-	wxTerminalLine& getLineAbsolute(int line){ return _content[line]; }
+	wxTerminalLine& getLineAbsolute(int line){ damageLine(line); return _content[line]; }
 	const wxTerminalLine& getLineAbsolute(int line)const{ return _content[line]; }
 
 	/** Retrieve a char, from its screen position.*/
@@ -140,17 +791,61 @@ public:
 	const wxTerminalCharacter& getChar(int line, int col)const{ return getLine(line)[col+_originPosition.x]; }
 
 	/** Retrieve the line of the caret.*/
-	wxTerminalLine& getCurrentLine(){ return _content[_caretPosition.y]; }
+	wxTerminalLine& getCurrentLine(){ damageLine(_caretPosition.y); return _content.getLine(_caretPosition.y); }
 	const wxTerminalLine& getCurrentLine()const{ return _content[_caretPosition.y]; }
 
+	/** Damaged columns of a line, from begin to end (excluded). */
+	struct Damage
+	{
+		size_t line;
+		int begin, end;
+
+		bool operator<(size_t l)const{return line < l;}
+	};
+
+	/** Mark columns of an absolute line as needing to be redrawn, the whole line by default. */
+	void damageLine(size_t line, int begin = 0, int end = INT_MAX);
+	/** Mark absolute lines as needing to be redrawn. */
+	void damageLines(size_t begin, size_t end);
+	/** Mark the whole screen as needing to be redrawn. */
+	void damageAll(){_damageAll = true;}
+	/** Retrieve the damaged lines, sorted by absolute line number. */
+	const std::vector<Damage>& getDamagedLines()const{return _damagedLines;}
+	/** Check if the whole screen is damaged. */
+	bool isAllDamaged()const{return _damageAll;}
+	/** Number of lines the origin moved since the damage was cleared, positive when moving down. */
+	int getScrollDelta()const{return (int)getOriginLine() - (int)_damageOrigin;}
+	/** Forget the damage, once redrawn. */
+	void clearDamage();
+
 	/** Retrieve the number of rows in content buffer.*/
 	size_t getHistoryRowCount()const{return _content.size();}
+	/** Retrieve the absolute position of the oldest row in content buffer.*/
+	size_t getHistoryFirstRow()const{return _content.getFirstLine();}
+
+	/** Retrieve the maximum number of rows kept in content buffer.*/
+	size_t getHistoryMaxRowCount()const{return _content.getMaxLines();}
+	/** Change the maximum number of rows kept in content buffer.*/
+	void setHistoryMaxRowCount(size_t rows){_content.setMaxLines(rows);}
+
+	/** Add the memory usage of the screen to statistics. */
+	void addStatistics(wxTerminalMemoryStatistics& stats)const;
+
+	/** Set the table of the hyperlinks referenced by the attributes, NULL if none. */
+	void setHyperlinkTable(wxTerminalHyperlinkTable* hyperlinks){_attributes.setHyperlinkTable(hyperlinks);}
+
+	/** Configure the compression of history rows.
+	 * @param level zlib level (1...9), 0 to disable compression.
+	 * @param hotRows Number of last rows never compressed. */
+	void setHistoryCompression(int level, size_t hotRows){_content.setCompressionLevel(level); _content.setHotLines(hotRows);}
+	/** Spill the history rows dropped from memory to a file, see wxTerminalContent::setSpill. */
+	bool setHistorySpill(size_t maxBytes, const wxString& path){return _content.setSpill(maxBytes, path);}
 
 	/** Retrieve the number of rows in screen (after origin in history).*/
-	size_t getScreenRowCount()const{return _content.size() >= _originPosition.y ? _content.size() - _originPosition.y : 0;}
+	size_t getScreenRowCount()const{return _content.getEndLine() > getOriginLine() ? _content.getEndLine() - getOriginLine() : 0;}
 
 	/** Retrieve the caret (textual cursor) position in relative coordinates. */
-	wxPoint getCaretPosition()const{return _caretPosition - _originPosition;}
+	wxPoint getCaretPosition()const{return _caretPosition - getOrigin();}
 	/** Retrieve the caret (textual cursor) position in absolute coordinates. */
 	wxPoint getCaretAbsolutePosition()const{return _caretPosition;}
 	/** Set the caret (textual cursor) position (in relative coordinates). */
@@ -176,11 +871,43 @@ public:
 	/** Insert a char just before the specified absolute position. */
 	void insertCharAbsolute(wxPoint pos, wxUniChar c, const wxTerminalCharacterAttributes& attr);
 
+	/** Retrieve the attributes of a character of this screen. */
+	const wxTerminalCharacterAttributes& getAttributes(const wxTerminalCharacter& ch)const{return _attributes.get(ch.attr);}
+	/** Retrieve the attribute index to use in characters of this screen. */
+	unsigned short getAttributeIndex(const wxTerminalCharacterAttributes& attr);
+
 	/** Insert a char at caret position and move caret by one.*/
 	void insertChar(wxUniChar c, const wxTerminalCharacterAttributes& attr);
 	/** Overwrite a char at caret position and move caret by one.*/
 	void overwriteChar(wxUniChar c, const wxTerminalCharacterAttributes& attr);
 
+	/** Retrieve the last column shifted by insertions and deletions at a column:
+	 * the right margin if the column is between the margins, the last column of the screen otherwise. */
+	int getRowEnd(int col)const{return col>=_scrollLeft && col<=_scrollRight ? _scrollRight : _size.x - 1;}
+	/** Insert blanks at caret position, the following characters are shifted right once
+	 * up to getRowEnd(), those pushed past it are lost. The caret does not move. */
+	void insertBlanks(unsigned int count);
+	/** Delete characters at caret position, the following ones up to getRowEnd() are shifted left once
+	 * and blanks come at the end. The caret does not move. */
+	void deleteCells(unsigned int count);
+	/** Erase characters from caret position to the end of the row at most, nothing is shifted. */
+	void eraseCells(unsigned int count);
+
+	/** Fill a rectangle (in screen coordinates, clipped to the screen) with a character. */
+	void fillRectangle(const wxRect& rect, wxTerminalCharacter ch);
+	/** Fill a rectangle (in screen coordinates, clipped to the screen) with a character. */
+	void fillRectangle(const wxRect& rect, wxUniChar c, const wxTerminalCharacterAttributes& attr);
+	/** Copy a rectangle (in screen coordinates) to another position, both are clipped to the screen and may overlap. */
+	void copyRectangle(const wxRect& rect, wxPoint dest);
+	/** Change the style of the characters of a rectangle (in screen coordinates, clipped to the screen)
+	 * to ((style & ~clear) | set) ^ toggle. Only their attribute indexes are modified. */
+	void changeRectangleStyle(const wxRect& rect, unsigned char clear, unsigned char set, unsigned char toggle);
+
+	/** Erase a line, from its screen position. */
+	void eraseLine(int line){eraseLineAbsolute(line + getOriginLine());}
+	/** Erase a line, from its absolute position, see wxTerminalContent::eraseLine. */
+	void eraseLineAbsolute(size_t line);
+
 	/** Insert lines at specified position. */
 	void insertLines(int pos, unsigned int count = 1);
 	/** Insert lines at specified absolute position. */
@@ -194,8 +921,37 @@ public:
 	/** Delete lines at caret position. */
 	void deleteLinesAtCarret(unsigned int count = 1);
 
+	/** Retrieve the first row of the scrolling region. */
+	int getScrollTop()const{return _scrollTop;}
+	/** Retrieve the last row of the scrolling region (included). */
+	int getScrollBottom()const{return _scrollBottom;}
+	/** Check if the scrolling region is smaller than the screen. */
+	bool hasScrollMargins()const{return _scrollTop>0 || _scrollBottom<_size.y-1;}
+	/** Set the scrolling region from its first to its last row, the whole screen if they are not valid. */
+	void setScrollMargins(int top, int bottom);
+	/** Retrieve the first column of the scrolling region. */
+	int getScrollLeft()const{return _scrollLeft;}
+	/** Retrieve the last column of the scrolling region (included). */
+	int getScrollRight()const{return _scrollRight;}
+	/** Check if the scrolling region is narrower than the screen. */
+	bool hasHorizontalMargins()const{return _scrollLeft>0 || _scrollRight<_size.x-1;}
+	/** Set the scrolling region from its first to its last column, the whole width if they are not valid. */
+	void setHorizontalMargins(int left, int right);
+	/** Scroll rows from top to bottom (included) up by count rows, down if count is negative.
+	 * Rows scrolled in are blank. With horizontal margins, only the columns between them move. */
+	void scrollRows(int top, int bottom, int count);
+	/** Scroll the columns from left to right (included) of rows from top to bottom (included)
+	 * to the left by count columns, to the right if count is negative. Columns scrolled in are blank. */
+	void scrollColumns(int top, int bottom, int left, int right, int count);
+	/** Scroll the scrolling region up, blank rows come at the bottom. */
+	void scrollUp(int count = 1){scrollRows(_scrollTop, _scrollBottom, count);}
+	/** Scroll the scrolling region down, blank rows come at the top. */
+	void scrollDown(int count = 1){scrollRows(_scrollTop, _scrollBottom, -count);}
+
 	/** Retrieve origin coordinates.*/
-	wxPoint getOrigin()const{return _originPosition;}
+	wxPoint getOrigin()const{return wxPoint(_originPosition.x, getOriginLine());}
+	/** Retrieve the absolute origin line, which cannot be before the oldest row of history. */
+	size_t getOriginLine()const{return std::max<size_t>(_originPosition.y, _content.getFirstLine());}
 	/** Move origin in history. */
 	void moveOrigin(int lines);
 	/** Set origin in history. */
@@ -203,8 +959,20 @@ public:
 
 	/** Retrieve the screen shown size (in chars). */
 	wxSize getScreenSize()const{return _size;}
-	/** Modify the screen size (in chars). */
-	void setScreenSize(wxSize sz){_size = sz;}
+	/** Modify the screen size (in chars).
+	 * When the width changes, the shown rows are rewrapped at once if reflow is enabled,
+	 * older ones when shown, see reflowHistory(). Rows are only clipped otherwise. */
+	void setScreenSize(wxSize sz);
+
+	/** Check if rows are rewrapped when the width changes. */
+	bool getReflow()const{return _reflow;}
+	/** Enable rewrapping rows when the width changes, clip them otherwise (alternate screen). */
+	void setReflow(bool reflow){_reflow = reflow;}
+	/** Rewrap the history from an absolute line if not done yet, keeping the caret and origin on their characters. */
+	void reflowHistory(size_t line);
+
+	/** Check if a row continues on the next one (soft wrap), from its screen position. */
+	bool isRowWrapped(int row)const{return _content.isWrapped(row + getOriginLine());}
 
 	/** Move caret by specified cols and lines.*/
 	void moveCaret(int lines, int cols);
@@ -215,9 +983,15 @@ public:
 	
 	
 protected:
+	/** Check that the characters only use indexes of the attribute table. */
+	bool checkAttributes()const;
+
 	/** Content of terminal screen, with potential history.*/
 	wxTerminalContent _content;
 
+	/** Attributes used by content characters. */
+	wxTerminalAttributeTable _attributes;
+
 	/** Position of origin (firstshown char of screen, top-left), in historic position. */  
 	wxPoint _originPosition;
 
@@ -226,45 +1000,32 @@ protected:
 
 	/** Screen shwon size (in chars). */
 	wxSize _size;
-	
-};
-
-
 
-
-enum wxTerminalCharacterSet
-{
-	wxTCSET_ISO_8859_1,
-	wxTCSET_UTF_8
+	/** True if rows are rewrapped when the width changes. */
+	bool _reflow;
+
+	/** Scrolling region, first and last rows (included). */
+	int _scrollTop, _scrollBottom;
+	/** Scrolling region, first and last columns (included). */
+	int _scrollLeft, _scrollRight;
+
+	/** Lines modified since the last redraw, sorted by absolute line number.
+	 * A vector keeps its capacity, damaging a line costs no allocation once warmed up. */
+	std::vector<Damage> _damagedLines;
+	/** Position of the last damaged line, usually damaged again by the next character. */
+	size_t _lastDamage;
+	/** True if everything must be redrawn. */
+	bool _damageAll;
+	/** Origin line at the last redraw. */
+	size_t _damageOrigin;
+
+	/** While the attribute table is full, end line from which it is collected again, see wxTerminalAttributeTable::MIN_COLLECTED. */
+	size_t _collectLine;
+	/** Attributes missing from the full attribute table since the last collect. */
+	unsigned int _collectMisses;
 };
 
 
-class wxTerminalCharacterDecoder
-{
-public:
-	wxTerminalCharacterDecoder();
-
-	void setCharacterSet(wxTerminalCharacterSet set);
-	wxTerminalCharacterSet getCharacterSet()const{return _set;}
-
-	bool add(unsigned char c, wxUniChar& ch);
-		
-protected:
-	wxTerminalCharacterSet _set;
-	unsigned long _buffer;
-
-	enum wxTerminalCharacterDecoderState
-	{
-		wxTCDSTATE_DEFAULT,
-		wxTCDSTATE_UTF8_2BYTES,
-		wxTCDSTATE_UTF8_3BYTES_1,
-		wxTCDSTATE_UTF8_3BYTES_2,
-		wxTCDSTATE_UTF8_4BYTES_1,
-		wxTCDSTATE_UTF8_4BYTES_2,
-		wxTCDSTATE_UTF8_4BYTES_3		
-	} _state;
-};
-
 
 
 class wxTerminalCharacterMap
@@ -281,6 +1042,8 @@ public:
 
 	static wxTerminalCharacterMap graphic, british, us, dutch, finnish, french, french_canadian, german, italian, norwegian,  spanish, swedish, swiss;
 	static const wxTerminalCharacterMap* getMap(char id);
+	/** Retrieve the designation of a map, the reverse of getMap(). */
+	static char getId(const wxTerminalCharacterMap* map);
 
 protected:
 	wxTerminalCharacterMap();
@@ -308,7 +1071,11 @@ enum wxTerminalOptionFlags
 	/** Enable/disable the application cursor mode. This changes the way cursor keys are sent from the keyboard. */
 	wxTOF_APPLICATION_CURSOR,
 	/** Enable/disable the application keypad mode. This change the way keypad keys are sent from keyboard. */
-	wxTOF_APPLICATION_KEYPAD
+	wxTOF_APPLICATION_KEYPAD,
+	/** Enable/disable the left and right margins (DECLRMM), CSI s sets them (DECSLRM) instead of saving the cursor. */
+	wxTOF_LEFT_RIGHT_MARGIN,
+	/** Attribute changes in areas (DECCARA, DECRARA) apply to rectangles instead of character streams (DECSACE). */
+	wxTOF_RECTANGLE_EXTENT
 };
 
 
@@ -328,12 +1095,18 @@ struct wxTerminalState
 
 	wxTerminalState();
 	wxTerminalState(const wxTerminalState& state);
+
+	/** Write the state to a session, character maps by their designation. */
+	void save(wxTerminalSessionWriter& out)const;
+	/** Restore the state from a session, return false if malformed. */
+	bool load(wxTerminalSessionReader& in);
 };
 
 
-class wxTerminalCtrl: public wxWindow, protected TerminalParser
+class wxTerminalCtrl: public wxWindow, protected TerminalParserT<wxTerminalCtrl>
 {
 	wxDECLARE_EVENT_TABLE();
+	friend class TerminalParserT<wxTerminalCtrl>;
 public:
     wxTerminalCtrl(wxWindow *parent, wxWindowID id, const wxPoint &pos=wxDefaultPosition,
         const wxSize &size=wxDefaultSize, long style=0, const wxString &name=wxTerminalCtrlNameStr);
@@ -349,6 +1122,42 @@ public:
 
 	void append(const unsigned char* buff, size_t sz);
 
+	/** Set the maximum number of lines kept in primary screen, including shown ones. */
+	void setScrollbackSize(size_t lines);
+	size_t getScrollbackSize()const;
+
+	/** Configure the compression of old primary screen lines.
+	 * @param level zlib level (1...9), 0 to disable compression.
+	 * @param hotLines Number of last lines never compressed. */
+	void setScrollbackCompression(int level, size_t hotLines);
+
+	/** Keep old primary screen lines dropped from memory in a memory-mapped file.
+	 * @param maxBytes Maximum size of the file, the oldest lines are lost beyond, 0 to disable.
+	 * @param path File to use, a temporary one if empty.
+	 * The file is removed when disabled or when the control is destroyed,
+	 * use saveSession() to keep the scrollback.
+	 * @return false if the file cannot be created. */
+	bool setScrollbackSpill(size_t maxBytes, const wxString& path = wxEmptyString);
+
+	/** Retrieve the memory usage of primary and alternate screens. */
+	wxTerminalMemoryStatistics getMemoryStatistics()const;
+
+	/**
+	 * Save the whole session to a file: both screens with their history,
+	 * cursor, current and saved states, options, tab stops and hyperlinks.
+	 * History is written mostly as its compressed blocks, not reparsed on load.
+	 */
+	bool saveSession(const wxString& path)const;
+	/**
+	 * Restore a session saved by saveSession(), the file is mapped in memory.
+	 * The spill file of the primary screen, if any, receives the spilled history.
+	 * @return false if the file cannot be read or is malformed, screens are then cleared.
+	 */
+	bool loadSession(const wxString& path);
+
+	/** Retrieve the URI of a hyperlink id found in character attributes. */
+	wxString getHyperlink(unsigned short id)const{return m_hyperlinks.get(id);}
+
 
 	void setWrapAround(bool val);
 	bool getWrapAround()const {return getOption(wxTOF_WRAPAROUND);}
@@ -379,6 +1188,12 @@ public:
 
 	void setApplicationKeypad(bool val);
 	bool getApplicationKeypad()const {return getOption(wxTOF_APPLICATION_KEYPAD);}
+
+	void setLeftRightMarginMode(bool val);
+	bool getLeftRightMarginMode()const {return getOption(wxTOF_LEFT_RIGHT_MARGIN);}
+
+	void setRectangleExtent(bool val);
+	bool getRectangleExtent()const {return getOption(wxTOF_RECTANGLE_EXTENT);}
 	
 	bool getOption(wxTerminalOptionFlags opt)const{return (m_options & (1 << opt)) != 0;}
 
@@ -390,6 +1205,10 @@ public:
 	void formFeed();
 	/** Process carriage return (0x0d). */
 	void carriageReturn();
+	/** Move the cursor down, scrolling the region when at its bottom (IND). */
+	void index();
+	/** Move the cursor up, scrolling the region when at its top (RI). */
+	void reverseIndex();
 
 
 	/** Move the cursor up a specified number of rows.*/
@@ -419,9 +1238,9 @@ public:
 	void eraseBelow();
 	/** Erase the screen.*/
 	void eraseScreen();
-	/** Insert lines at cursor position.*/
+	/** Insert lines at cursor position, the following ones are moved down up to the bottom of the scrolling region.*/
 	void insertLines(unsigned int count = 1);
-	/** Delete lines at cursor position.*/
+	/** Delete lines at cursor position, the following ones are moved up up to the bottom of the scrolling region.*/
 	void deleteLines(unsigned int count = 1);
 
 
@@ -456,6 +1275,9 @@ public:
 	void saveState();
 	/** Restore terminal state from saved state. */
 	void restoreState();
+	/** Compose the GL/GR character maps of the current state in the translation table.
+	 * Must be called each time a G-set designation or invocation changes. */
+	void updateCharsetTable();
 	/** Set alternate mode.
 	 * @param alternate @true to use alternate screen and @false to use normal screen. */
 	void setAlternateMode(bool alternate);
@@ -473,8 +1295,24 @@ protected:
 	/** Recompute scroll bar states (size and pos) from console size and historic position and size.*/ 
 	void UpdateScrollBars();
 
+	/** Refresh the parts of the window damaged in the current screen since the last call, scrolling it if its origin moved. */
+	void RefreshDamage();
+
 	/** Update caret widget position. */
 	void UpdateCaret();
+
+	/** Convert the 1-based bounds of a rectangular area (0 for the screen edges) to a rectangle of the screen.
+	 * In origin mode, they are relative to the scrolling region. */
+	wxRect GetRectangularArea(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right)const;
+	/** Change the style of a rectangular area (DECCARA), or reverse it (DECRARA).
+	 * Following DECSACE, the area is a rectangle or the characters from its start to its end. */
+	void ChangeAreaStyle(TerminalParserParams nbs, bool reverse);
+
+	/** Restore a session from its mapped file, see loadSession(). */
+	bool LoadSession(wxTerminalSessionReader& in);
+
+	/** Retrieve the colour of a palette index or wxTERMINAL_COLOR_RGB value. */
+	wxColour GetColour(unsigned int color)const;
 	
 	/** Send some chars to the shell. Same format as printf. */
 	void send(const char* msg, ...);
@@ -483,8 +1321,10 @@ protected:
 	
 	/**
 	 * Declaration of TerminalParser interface abstract functions
+	 * Handlers are statically dispatched, they shadow the TerminalParserT defaults.
 	 * \{ */
-	/*overriden*/ void onPrintableChar(unsigned char c);
+	using TerminalParserT<wxTerminalCtrl>::onOSC;
+	/*overriden*/ void onPrintableText(TerminalParserText text);
 
 	// ESC:
 	//------
@@ -597,19 +1437,19 @@ protected:
 	/*overriden*/ void onSD(unsigned short nb=1);  // Scroll down Ps lines (default = 1)
 	/*overriden*/ void onECH(unsigned short nb=1);  // Erase Ps Character(s) (default = 1)
 	/*overriden*/ void onCBT(unsigned short nb=1);  // Cursor Backward Tabulation Ps tab stops (default = 1)
-	/*overriden*/ void onHPA(const std::vector<unsigned short> nbs);  // Character Position Absolute [column] (default = [row,1]) (HPA).
-	/*overriden*/ void onHPR(const std::vector<unsigned short> nbs);  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
-	/*overriden*/ void onVPA(const std::vector<unsigned short> nbs);  // Line Position Absolute [row] (default = [1,column])
-	/*overriden*/ void onVPR(const std::vector<unsigned short> nbs);  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
+	/*overriden*/ void onHPA(TerminalParserParams nbs);  // Character Position Absolute [column] (default = [row,1]) (HPA).
+	/*overriden*/ void onHPR(TerminalParserParams nbs);  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
+	/*overriden*/ void onVPA(TerminalParserParams nbs);  // Line Position Absolute [row] (default = [1,column])
+	/*overriden*/ void onVPR(TerminalParserParams nbs);  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
 	/*overriden*/ void onHVP(unsigned short row=1, unsigned short col=1); // Horizontal and Vertical Position [row;column] (default = [1,1])
 	/*overriden*/ void onTBC(unsigned short nb=0);  // Tab Clear
-	/*overriden*/ void onSM(const std::vector<unsigned short> nbs);  // Set Mode
-	/*overriden*/ void onDECSET(const std::vector<unsigned short> nbs);  // DEC Private Mode Set
-	/*overriden*/ void onMC(const std::vector<unsigned short> nbs);  // Media Copy
-	/*overriden*/ void onDECMC(const std::vector<unsigned short> nbs);  // DEC specific Media Copy
-	/*overriden*/ void onRM(const std::vector<unsigned short> nbs);  // Reset Mode
-	/*overriden*/ void onDECRST(const std::vector<unsigned short> nbs);  // DEC Private Mode Reset
-	/*overriden*/ void onSGR(const std::vector<unsigned short> nbs);  // Character Attributes
+	/*overriden*/ void onSM(TerminalParserParams nbs);  // Set Mode
+	/*overriden*/ void onDECSET(TerminalParserParams nbs);  // DEC Private Mode Set
+	/*overriden*/ void onMC(TerminalParserParams nbs);  // Media Copy
+	/*overriden*/ void onDECMC(TerminalParserParams nbs);  // DEC specific Media Copy
+	/*overriden*/ void onRM(TerminalParserParams nbs);  // Reset Mode
+	/*overriden*/ void onDECRST(TerminalParserParams nbs);  // DEC Private Mode Reset
+	/*overriden*/ void onSGR(TerminalParserParams nbs);  // Character Attributes
 	/*overriden*/ void onDSR(unsigned short nb);  // Device Status Report
 	/*overriden*/ void onDECDSR(unsigned short nb);  // DEC-specific Device Status Report
 	/*overriden*/ void onDECSTR();  // Soft terminal reset
@@ -619,17 +1459,17 @@ protected:
 	/*overriden*/ void onDECSCUSR(unsigned short nb);  // Set cursor style (DECSCUSR, VT520).
 	/*overriden*/ void onDECSCA(unsigned short nb=0);  // Select character protection attribute (DECSCA).
 	/*overriden*/ void onDECSTBM(unsigned short top=0, unsigned short bottom=0); // Set Scrolling Region [top;bottom] (default = full size of window)
- 	/*overriden*/ void onRDECPMV(const std::vector<unsigned short> nbs);  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
-	/*overriden*/ void onSDECPMV(const std::vector<unsigned short> nbs);  // Save DEC Private Mode Values. P s values are the same as for DECSET.
-	/*overriden*/ void onDECCARA(const std::vector<unsigned short> nbs);  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
+ 	/*overriden*/ void onRDECPMV(TerminalParserParams nbs);  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
+	/*overriden*/ void onSDECPMV(TerminalParserParams nbs);  // Save DEC Private Mode Values. P s values are the same as for DECSET.
+	/*overriden*/ void onDECCARA(TerminalParserParams nbs);  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
 	/*overriden*/ void onDECSLRM(unsigned short left, unsigned short right); // Set left and right margins (DECSLRM), available only when DECLRMM is enabled (VT420 and up).
 	/*overriden*/ void onANSISC();  // Save cursor (ANSI.SYS), available only when DECLRMM is disabled.
 	/*overriden*/ void onANSIRC();  // Restore cursor (ANSI.SYS).
 	/*overriden*/ void onWindowManip(unsigned short nb1, unsigned short nb2=0, unsigned short nb3=0); // Set conformance level
-	/*overriden*/ void onDECRARA(const std::vector<unsigned short> nbs);  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
+	/*overriden*/ void onDECRARA(TerminalParserParams nbs);  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
 	/*overriden*/ void onDECSWBV(unsigned short nb);  // Set warning-bell volume (DECSWBV, VT520).
 	/*overriden*/ void onDECSMBV(unsigned short nb);  // Set margin-bell volume (DECSMBV, VT520).
-	/*overriden*/ void onDECCRA(const std::vector<unsigned short> nbs);  // Copy Rectangular Area (DECCRA, VT400 and up).
+	/*overriden*/ void onDECCRA(TerminalParserParams nbs);  // Copy Rectangular Area (DECCRA, VT400 and up).
 	/*overriden*/ void onDECEFR(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right); // Enable Filter Rectangle (DECEFR), VT420 and up.
 	/*overriden*/ void onDECREQTPARM(unsigned short nb);  // Request Terminal Parameters
 	/*overriden*/ void onDECSACE(unsigned short nb);  // Select Attribute Change Extent
@@ -637,7 +1477,7 @@ protected:
 	/*overriden*/ void onDECRQCRA(unsigned short id, unsigned short page, unsigned short top, unsigned short left, unsigned short bottom, unsigned short right); // Request Checksum of Rectangular Area (DECRQCRA), VT420 and up.
 	/*overriden*/ void onDECELR(unsigned short nb1, unsigned short nb2); // Enable Locator Reporting (DECELR).
 	/*overriden*/ void onDECERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right); // Erase Rectangular Area (DECERA), VT400 and up.
-	/*overriden*/ void onDECSLE(const std::vector<unsigned short> nbs);  // Select Locator Events (DECSLE).
+	/*overriden*/ void onDECSLE(TerminalParserParams nbs);  // Select Locator Events (DECSLE).
 	/*overriden*/ void onDECSERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right); // Selective Erase Rectangular Area (), VT400 and up.
  	/*overriden*/ void onDECRQLP(unsigned short nb);  // Request Locator Position (DECRQLP).
 	/*overriden*/ void onDECIC(unsigned short nb=1);  // Insert P s Column(s) (default = 1) (DECIC), VT420 and up.
@@ -671,14 +1511,19 @@ private:
 	wxFont m_defaultFont, m_boldFont, m_underlineFont, m_boldUnderlineFont;
 	wxColour m_colours[8];
 
-	wxTerminalCharacterSet m_charset; // Current input character set
-	wxTerminalCharacterDecoder m_mbdecoder; // Multibyte decoder (for UTF-x) 
+	/** Hyperlink URIs (OSC 8) of both screens. */
+	wxTerminalHyperlinkTable m_hyperlinks;
 
 	/** Current and saved terminal state.
 	 * Note: cursor position in current state is not used, refer to currentScreen cursor position instead.
 	 */
 	wxTerminalState m_currentState, m_savedState;
 
+	/** Translation of code points 0...255 through current GL (0x00-0x7F) and GR (0x80-0xFF) maps. */
+	char32_t m_charsetTable[256];
+	/** True if both GL and GR invoke US-ASCII, text is then displayed untranslated. */
+	bool m_charsetIdentity;
+
 	unsigned int m_options; // Flags from wxTerminalOptionFlags
 
 	unsigned int m_tabWidth; // Size of tab in chars
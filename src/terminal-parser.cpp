@@ -21,6 +21,12 @@ wxTerminal is free software: you can redistribute it and/or modify it
 
 #include <iostream>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 //
 //
 // TerminalParser
@@ -33,7 +39,10 @@ wxTerminal is free software: you can redistribute it and/or modify it
 //    - for one-char, calling esc_dispatch directly
 //    - for two-char, collecting in m_escapedFirstChar (instead of m_collected) and call two param version of esc_dispatch. 
 //    - esc_dispatch calls have been replaced by direct calls to onESC(...)
-//  - OSC is parsed differently from osc's start/put/end, the first number is parsed and the rest is buffered as is.
+//  - OSC is parsed differently from osc's start/put/end, the first number is parsed and the rest is delivered as is, by chunks.
+//  - OSC and DCS payloads are bounded, see TerminalParserBase::SetPayloadLimit.
+//  - the state diagram is compiled into a [state][char] table of (action, next state),
+//    see TerminalParserBase::Table, so processing a char is one indexed load and one action.
 //
 // Other useful pointers:
 //  - http://vt100.net/emu/
@@ -51,1052 +60,447 @@ wxTerminal is free software: you can redistribute it and/or modify it
 //
 //
 
-TerminalParser::TerminalParser():
-m_state(WXTP_STATE_GROUND)
+TerminalParserBase::TerminalParserBase():
+m_state(WXTP_STATE_GROUND),
+m_table(&s_tables[0]),
+m_groundControlMask(0xE0),
+m_utf8(false),
+m_subParams(0),
+m_payloadLimit(DEFAULT_PAYLOAD_LIMIT),
+m_payloadSize(0),
+m_payloadTruncated(false),
+m_oscActive(false),
+m_oscCommand(0)
 {
 }
 
-void TerminalParser::Process(unsigned char c)
+//
+// Transition tables.
+//
+constexpr TerminalParserBase::Table::Table(bool c1Controls):
+	transitions(),
+	entryActions(),
+	exitActions()
 {
-	// Parse "Anywhere" entries
-	// {
-	if( c==0x18 || c==0x1A || c==0x1B )
-	{
-		// Execute (transition is done in default handler when needed).
-		executeC0ControlCode(c);
-		return;
-	}
-	else if( c>=0x80 && c<=0x9F )
+	// GROUND
+	set(WXTP_STATE_GROUND, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_GROUND, 0x20, 0xFF, WXTP_ACTION_PRINT); // Including extended character / GR Area
+
+	// ESCAPE
+	entryActions[WXTP_STATE_ESCAPE] = WXTP_ACTION_CLEAR;
+	set(WXTP_STATE_ESCAPE, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_ESCAPE, 0x20, 0x2F, WXTP_ACTION_ESC_COLLECT, WXTP_STATE_ESCAPE_INTERMEDIATE);
+	set(WXTP_STATE_ESCAPE, 0x30, 0xFF, WXTP_ACTION_ESC_DISPATCH, WXTP_STATE_GROUND); // EKI What about GR Area ???
+	set(WXTP_STATE_ESCAPE, 0x50, 0x50, WXTP_ACTION_NONE, WXTP_STATE_DCS_ENTRY);
+	set(WXTP_STATE_ESCAPE, 0x58, 0x58, WXTP_ACTION_NONE, WXTP_STATE_SOS_PM_APC_STRING);
+	set(WXTP_STATE_ESCAPE, 0x5E, 0x5F, WXTP_ACTION_NONE, WXTP_STATE_SOS_PM_APC_STRING);
+	set(WXTP_STATE_ESCAPE, 0x5B, 0x5B, WXTP_ACTION_NONE, WXTP_STATE_CSI_ENTRY);
+	set(WXTP_STATE_ESCAPE, 0x5D, 0x5D, WXTP_ACTION_NONE, WXTP_STATE_OSC_ENTRY);
+	set(WXTP_STATE_ESCAPE, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// ESCAPE_INTERMEDIATE
+	set(WXTP_STATE_ESCAPE_INTERMEDIATE, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_ESCAPE_INTERMEDIATE, 0x20, 0x2F, WXTP_ACTION_COLLECT); // EKI: escaped sequence cannot have more than two characters ??
+	set(WXTP_STATE_ESCAPE_INTERMEDIATE, 0x30, 0xFF, WXTP_ACTION_ESC2_DISPATCH, WXTP_STATE_GROUND);
+	set(WXTP_STATE_ESCAPE_INTERMEDIATE, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// CSI_ENTRY
+	entryActions[WXTP_STATE_CSI_ENTRY] = WXTP_ACTION_CLEAR;
+	set(WXTP_STATE_CSI_ENTRY, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_CSI_ENTRY, 0x20, 0x2F, WXTP_ACTION_COLLECT, WXTP_STATE_CSI_INTERMEDIATE);
+	set(WXTP_STATE_CSI_ENTRY, 0x30, 0x39, WXTP_ACTION_PARAM, WXTP_STATE_CSI_PARAM);
+	set(WXTP_STATE_CSI_ENTRY, 0x3A, 0x3B, WXTP_ACTION_PARAM, WXTP_STATE_CSI_PARAM); // Sub-parameter (colon) and parameter separators
+	set(WXTP_STATE_CSI_ENTRY, 0x3C, 0x3F, WXTP_ACTION_COLLECT, WXTP_STATE_CSI_PARAM);
+	set(WXTP_STATE_CSI_ENTRY, 0x40, 0xFF, WXTP_ACTION_CSI_DISPATCH, WXTP_STATE_GROUND);
+	set(WXTP_STATE_CSI_ENTRY, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// CSI_PARAM
+	set(WXTP_STATE_CSI_PARAM, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_CSI_PARAM, 0x20, 0x2F, WXTP_ACTION_COLLECT, WXTP_STATE_CSI_INTERMEDIATE);
+	set(WXTP_STATE_CSI_PARAM, 0x30, 0x39, WXTP_ACTION_PARAM);
+	set(WXTP_STATE_CSI_PARAM, 0x3A, 0x3F, WXTP_ACTION_NONE, WXTP_STATE_CSI_IGNORE);
+	set(WXTP_STATE_CSI_PARAM, 0x3A, 0x3B, WXTP_ACTION_PARAM); // Sub-parameter (colon) and parameter separators
+	set(WXTP_STATE_CSI_PARAM, 0x40, 0xFF, WXTP_ACTION_CSI_DISPATCH, WXTP_STATE_GROUND);
+	set(WXTP_STATE_CSI_PARAM, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// CSI_INTERMEDIATE
+	set(WXTP_STATE_CSI_INTERMEDIATE, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_CSI_INTERMEDIATE, 0x20, 0x2F, WXTP_ACTION_COLLECT);
+	set(WXTP_STATE_CSI_INTERMEDIATE, 0x30, 0x3F, WXTP_ACTION_NONE, WXTP_STATE_CSI_IGNORE);
+	set(WXTP_STATE_CSI_INTERMEDIATE, 0x40, 0xFF, WXTP_ACTION_CSI_DISPATCH, WXTP_STATE_GROUND);
+	set(WXTP_STATE_CSI_INTERMEDIATE, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// CSI_IGNORE
+	set(WXTP_STATE_CSI_IGNORE, 0x00, 0x1F, WXTP_ACTION_EXECUTE);
+	set(WXTP_STATE_CSI_IGNORE, 0x20, 0x3F, WXTP_ACTION_NONE);
+	set(WXTP_STATE_CSI_IGNORE, 0x40, 0xFF, WXTP_ACTION_NONE, WXTP_STATE_GROUND);
+	set(WXTP_STATE_CSI_IGNORE, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// DCS_ENTRY
+	entryActions[WXTP_STATE_DCS_ENTRY] = WXTP_ACTION_CLEAR;
+	set(WXTP_STATE_DCS_ENTRY, 0x00, 0x1F, WXTP_ACTION_NONE);
+	set(WXTP_STATE_DCS_ENTRY, 0x20, 0x2F, WXTP_ACTION_COLLECT, WXTP_STATE_DCS_INTERMEDIATE);
+	set(WXTP_STATE_DCS_ENTRY, 0x30, 0x39, WXTP_ACTION_PARAM, WXTP_STATE_DCS_PARAM);
+	set(WXTP_STATE_DCS_ENTRY, 0x3A, 0x3A, WXTP_ACTION_NONE, WXTP_STATE_DCS_IGNORE);
+	set(WXTP_STATE_DCS_ENTRY, 0x3B, 0x3B, WXTP_ACTION_PARAM, WXTP_STATE_DCS_PARAM);
+	set(WXTP_STATE_DCS_ENTRY, 0x3C, 0x3F, WXTP_ACTION_COLLECT, WXTP_STATE_DCS_PARAM);
+	set(WXTP_STATE_DCS_ENTRY, 0x40, 0xFF, WXTP_ACTION_NONE, WXTP_STATE_DCS_PASSTHROUGH); // EKI What about GR Area ???
+	set(WXTP_STATE_DCS_ENTRY, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// DCS_PARAM
+	set(WXTP_STATE_DCS_PARAM, 0x00, 0x1F, WXTP_ACTION_NONE);
+	set(WXTP_STATE_DCS_PARAM, 0x20, 0x2F, WXTP_ACTION_COLLECT, WXTP_STATE_DCS_INTERMEDIATE);
+	set(WXTP_STATE_DCS_PARAM, 0x30, 0x39, WXTP_ACTION_PARAM);
+	set(WXTP_STATE_DCS_PARAM, 0x3A, 0x3F, WXTP_ACTION_NONE, WXTP_STATE_DCS_IGNORE);
+	set(WXTP_STATE_DCS_PARAM, 0x3B, 0x3B, WXTP_ACTION_PARAM);
+	set(WXTP_STATE_DCS_PARAM, 0x40, 0xFF, WXTP_ACTION_NONE, WXTP_STATE_DCS_PASSTHROUGH);
+	set(WXTP_STATE_DCS_PARAM, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// DCS_INTERMEDIATE
+	set(WXTP_STATE_DCS_INTERMEDIATE, 0x00, 0x1F, WXTP_ACTION_NONE);
+	set(WXTP_STATE_DCS_INTERMEDIATE, 0x20, 0x2F, WXTP_ACTION_COLLECT);
+	set(WXTP_STATE_DCS_INTERMEDIATE, 0x30, 0x3F, WXTP_ACTION_NONE, WXTP_STATE_DCS_IGNORE);
+	set(WXTP_STATE_DCS_INTERMEDIATE, 0x40, 0xFF, WXTP_ACTION_NONE, WXTP_STATE_DCS_PASSTHROUGH);
+	set(WXTP_STATE_DCS_INTERMEDIATE, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// DCS_PASSTHROUGH
+	entryActions[WXTP_STATE_DCS_PASSTHROUGH] = WXTP_ACTION_HOOK;
+	exitActions[WXTP_STATE_DCS_PASSTHROUGH] = WXTP_ACTION_UNHOOK;
+	set(WXTP_STATE_DCS_PASSTHROUGH, 0x00, 0xFF, WXTP_ACTION_PUT);
+	set(WXTP_STATE_DCS_PASSTHROUGH, 0x7F, 0x7F, WXTP_ACTION_NONE);
+
+	// DCS_IGNORE
+	set(WXTP_STATE_DCS_IGNORE, 0x00, 0xFF, WXTP_ACTION_NONE);
+
+	// OSC_ENTRY
+	entryActions[WXTP_STATE_OSC_ENTRY] = WXTP_ACTION_CLEAR;
+	set(WXTP_STATE_OSC_ENTRY, 0x00, 0xFF, WXTP_ACTION_OSC_PUT); // Moves to OSC_STRING before putting the char
+	set(WXTP_STATE_OSC_ENTRY, '0', '9', WXTP_ACTION_PARAM);
+	set(WXTP_STATE_OSC_ENTRY, ';', ';', WXTP_ACTION_NONE, WXTP_STATE_OSC_STRING);
+	set(WXTP_STATE_OSC_ENTRY, 0x07, 0x07, WXTP_ACTION_NONE, WXTP_STATE_GROUND); // BEL
+
+	// OSC_STRING
+	entryActions[WXTP_STATE_OSC_STRING] = WXTP_ACTION_OSC_START;
+	exitActions[WXTP_STATE_OSC_STRING] = WXTP_ACTION_OSC_END;
+	set(WXTP_STATE_OSC_STRING, 0x00, 0x1F, WXTP_ACTION_NONE);
+	set(WXTP_STATE_OSC_STRING, 0x20, 0xFF, WXTP_ACTION_OSC_PUT);
+	set(WXTP_STATE_OSC_STRING, 0x07, 0x07, WXTP_ACTION_NONE, WXTP_STATE_GROUND); // BEL
+
+	// SOS_PM_APC_STRING
+	set(WXTP_STATE_SOS_PM_APC_STRING, 0x00, 0xFF, WXTP_ACTION_NONE);
+
+	// "Anywhere" entries, override all states.
+	// Transitions (if any) are done by the default control handlers.
+	// ST (0x9C) is catched here for string states.
+	// Without 8-bit controls, 0x80-0x9F are handled as 0xA0-0xFF.
+	for(int state=0; state<WXTP_STATE_COUNT; ++state)
 	{
-		// Execute (transition is done in default handler when needed).
-		executeC1ControlCode(c);
-		return;
-	}
-
-	// Real state dependant processing
-	switch(m_state)
-	{
-		case WXTP_STATE_GROUND:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1B, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(/* c >= 0x20 && */ c <= 0x7F) // ASCII printable character
-			{
-				// print
-				onPrintableChar(c);
-			}
-			//  c>= 0x80 && c <= 0x9F : Globally processed
-			else // Extended character / GR Area ( c >= 0xA0 && c <= FF ) => GL  
-			{
-				// print
-				onPrintableChar(c);				
-			}
-			break;
-		}
-		case WXTP_STATE_ESCAPE:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(c <= 0x2F)
-			{
-				// collect // Special char collect
-				m_escapedFirstChar = c;
-				// goto WXTP_STATE_ESCAPE_INTERMEDIATE
-				Transition(WXTP_STATE_ESCAPE_INTERMEDIATE);
-			}
-			else if(c == 0x50)
-			{
-				// goto WXTP_STATE_DCS_ENTRY
-				Transition(WXTP_STATE_DCS_ENTRY);
-			}
-			else if(c == 0x58 || c == 0x5E || c == 0x5F)
-			{
-				// goto WXTP_STATE_SOS_PM_APC_STRING
-				Transition(WXTP_STATE_SOS_PM_APC_STRING);
-			}
-			else if(c == 0x5B)
-			{
-				// goto WXTP_STATE_CSI_ENTRY
-				Transition(WXTP_STATE_CSI_ENTRY);
-			}
-			else if(c == 0x5D)
-			{
-				// goto WXTP_STATE_OSC_ENRTY
-				Transition(WXTP_STATE_OSC_ENTRY);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{
-				// esc_dispatch // Direct call to onESC(cmd)
-				onESC(c);
-				// EKI What about GR Area ???
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			break;
-		}
-		case WXTP_STATE_ESCAPE_INTERMEDIATE:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				// EKI: escaped sequence cannot have more than two characters ??
-				Collect(c);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{
-				// esc_dispatch // Direct call to onESC(cmd, param)
-				onESC(m_escapedFirstChar, c);
-				// EKI What about GR Area ???
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			break;
-		}
-		case WXTP_STATE_CSI_ENTRY:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_CSI_INTERMEDIATE
-				Transition(WXTP_STATE_CSI_INTERMEDIATE);
-			}
-			else if(c == 0x3A)
-			{
-				// goto WXTP_STATE_CSI_IGNORE
-				Transition(WXTP_STATE_CSI_IGNORE);
-			}
-			else if(c <= 0x3B)
-			{
-				// param
-				Param(c);
-				// goto WXTP_STATE_CSI_PARAM
-				Transition(WXTP_STATE_CSI_PARAM);
-			}
-			else if(c <= 0x3F)
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_CSI_PARAM
-				Transition(WXTP_STATE_CSI_PARAM);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{
-				// csi_dispatch // Direct call to onCSI(cmd, params, m_collected)
-				onCSI(c, m_params, m_collected);
-				// EKI What about GR Area ???
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			break;
-		}
-		case WXTP_STATE_CSI_PARAM:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_CSI_INTERMEDIATE
-				Transition(WXTP_STATE_CSI_INTERMEDIATE);
-			}
-			else if(c <= 0x39 || c == 0x3B)
-			{
-				// param
-				Param(c);
-			}
-			else if(c <= 0x3F)
-			{
-				// goto WXTP_STATE_CSI_IGNORE
-				Transition(WXTP_STATE_CSI_IGNORE);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{
-				// csi_dispatch
-				onCSI(c, m_params, m_collected);
-				// EKI What about GR Area ???
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			break;
-		}
-		case WXTP_STATE_CSI_INTERMEDIATE:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				Collect(c);
-			}
-			else if(c <= 0x3F)
-			{
-				// goto WXTP_STATE_CSI_IGNORE
-				Transition(WXTP_STATE_CSI_IGNORE);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{
-				// csi_dispatch
-				onCSI(c, m_params, m_collected);
-				// EKI What about GR Area ???
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			break;
-		}
-		case WXTP_STATE_CSI_IGNORE:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// execute
-				executeC0ControlCode(c);
-			}
-			else if(c <= 0x3F || c == 0x7F)
-			{
-				// ignore
-			}
-			else
-			{// EKI What about GR Area ???
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}			
-			break;
-		}
-		case WXTP_STATE_DCS_ENTRY:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// ignore
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_DCS_INTERMEDIATE
-				Transition(WXTP_STATE_DCS_INTERMEDIATE);
-			}
-			else if(c == 0x3A)
-			{
-				// goto WXTP_STATE_DCS_IGNORE
-				Transition(WXTP_STATE_DCS_IGNORE);
-			}
-			else if(c <= 0x3B)
-			{
-				// param
-				Param(c);
-				// goto WXTP_STATE_DCS_PARAM
-				Transition(WXTP_STATE_DCS_PARAM);
-			}
-			else if(c <= 0x3F)
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_DCS_PARAM
-				Transition(WXTP_STATE_DCS_PARAM);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{// EKI What about GR Area ???
-				// goto WXTP_STATE_DCS_PASSTHROUGH
-				Transition(WXTP_STATE_DCS_PASSTHROUGH);
-			}
-			break;
-		}
-		case WXTP_STATE_DCS_PARAM:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// ignore
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_DCS_INTERMEDIATE
-				Transition(WXTP_STATE_DCS_INTERMEDIATE);
-			}
-			else if(c <= 0x39 || c == 0x3B)
-			{
-				// param
-				Param(c);
-			}
-			else if(c <= 0x3F)
-			{
-				// goto WXTP_STATE_DCS_IGNORE
-				Transition(WXTP_STATE_DCS_IGNORE);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{// EKI What about GR Area ???
-				// goto WXTP_STATE_DCS_PASSTHROUGH
-				Transition(WXTP_STATE_DCS_PASSTHROUGH);
-			}
-			break;
-		}
-		case WXTP_STATE_DCS_INTERMEDIATE:
-		{
-			if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// ignore
-			}
-			else if(c <= 0x2F)
-			{
-				// collect
-				Collect(c);
-			}
-			else if(c <= 0x3F)
-			{
-				// goto WXTP_STATE_DCS_IGNORE
-				Transition(WXTP_STATE_DCS_IGNORE);
-			}
-			else if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else
-			{// EKI What about GR Area ???
-				// goto WXTP_STATE_DCS_PASSTHROUGH
-				Transition(WXTP_STATE_DCS_PASSTHROUGH);
-			}
-			break;
-		}
-		case WXTP_STATE_DCS_PASSTHROUGH:
-		{
-			if(c == 0x7F)
-			{
-				// Ignore
-			}
-			else if(c == 0x9C)
-			{
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			else
-			{
-				// put
-				DcsPut(c);
-			}
-			// EKI What about GR Area ???
-			break;
-		}
-		case WXTP_STATE_DCS_IGNORE:
-		{
-			if(c == 0x9C)
-			{
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			else
-			{
-				// ignore
-			}
-			// EKI What about GR Area ???
-			break;
-		}
-		case WXTP_STATE_OSC_ENTRY:
-		{
-			if( c >= '0' && c <= '9' ) // 0x30 - 0x39
-			{
-				Param(c);
-			}
-			else if( c == 0x9C || c == 0x07 ) // ST || BEL
-			{
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			else if( c == ';' ) // 0x3B
-			{
-				// goto WXTP_STATE_OSC_STRING
-				Transition(WXTP_STATE_OSC_STRING);
-			}
-			else
-			{
-				// collect
-				Collect(c);
-				// goto WXTP_STATE_OSC_STRING
-				Transition(WXTP_STATE_OSC_STRING);
-			}
-			break;
-		}
-		case WXTP_STATE_OSC_STRING:
-		{
-			if(c == 0x9C || c == 0x07 ) // ST || BEL
-			{
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			else if(c <= 0x1F) // except 18, 1A, 1b, but already processed
-			{
-				// ignore
-			}
-			else //if(c <= 0x7F)
-			{
-				// ocs_put
-				Collect(c);
-			}
-			// EKI What about GR Area ???
-			break;
-		}
-		case WXTP_STATE_SOS_PM_APC_STRING:
-		{
-			if(c == 0x9C)
-			{
-				// goto WXTP_STATE_GROUND
-				Transition(WXTP_STATE_GROUND);
-			}
-			else
-			{
-				// ignore
-			}
-			// EKI What about GR Area ???
-			break;
-		}
-		default:
-			/* Must not occurs ! */
-			break;
+		set(state, 0x18, 0x18, WXTP_ACTION_EXECUTE); // CAN
+		set(state, 0x1A, 0x1B, WXTP_ACTION_EXECUTE); // SUB, ESC
+		if(c1Controls)
+			set(state, 0x80, 0x9F, WXTP_ACTION_EXECUTE_C1);
 	}
 }
 
-void TerminalParser::Transition(WXTP_STATE state)
+constexpr void TerminalParserBase::Table::set(int state, int first, int last, int action, int next)
 {
-	// Exit old state
-	switch(m_state)
-	{
-		case WXTP_STATE_DCS_PASSTHROUGH:
-			DcsUnhook();
-			break;
-		case WXTP_STATE_OSC_STRING:
-			if(m_params.size()>0)
-				onOSC(m_params[0], m_collected);
-			break;
-		case WXTP_STATE_GROUND:
-		case WXTP_STATE_ESCAPE:
-		case WXTP_STATE_ESCAPE_INTERMEDIATE:
-		case WXTP_STATE_CSI_ENTRY:
-		case WXTP_STATE_CSI_PARAM:
-		case WXTP_STATE_CSI_INTERMEDIATE:
-		case WXTP_STATE_CSI_IGNORE:
-		case WXTP_STATE_DCS_ENTRY:
-		case WXTP_STATE_DCS_PARAM:
-		case WXTP_STATE_DCS_INTERMEDIATE:
-		case WXTP_STATE_DCS_IGNORE:
-		case WXTP_STATE_OSC_ENTRY:
-		case WXTP_STATE_SOS_PM_APC_STRING:
-		default:
-			break; /* Nothing specified. */
-	}
-
-	m_state = state;
-	
-	// Enter new state
-	switch(m_state)
-	{
-		case WXTP_STATE_ESCAPE:
-		case WXTP_STATE_CSI_ENTRY:
-		case WXTP_STATE_DCS_ENTRY:
-		case WXTP_STATE_OSC_ENTRY:
-			Clear();
-			break;
-		case WXTP_STATE_DCS_PASSTHROUGH:
-			DcsHook();
-			break;
-		case WXTP_STATE_OSC_STRING:
-		case WXTP_STATE_GROUND:
-		case WXTP_STATE_ESCAPE_INTERMEDIATE:
-		case WXTP_STATE_CSI_PARAM:
-		case WXTP_STATE_CSI_INTERMEDIATE:
-		case WXTP_STATE_CSI_IGNORE:
-		case WXTP_STATE_DCS_PARAM:
-		case WXTP_STATE_DCS_INTERMEDIATE:
-		case WXTP_STATE_DCS_IGNORE:
-		case WXTP_STATE_SOS_PM_APC_STRING:
-		default:
-			break; /* Nothing specified. */
-	}
+	for(int c=first; c<=last; ++c)
+		transitions[state][c] = (unsigned char)((action << 4) | next);
 }
 
+const TerminalParserBase::Table TerminalParserBase::s_tables[2] = {
+	TerminalParserBase::Table(false),
+	TerminalParserBase::Table(true)
+};
 
-void TerminalParser::executeC0ControlCode(unsigned char c)
+void TerminalParserBase::SetUTF8(bool utf8)
 {
-	switch(c)
-	{
-		case 0x00: onNUL();	break;
-		case 0x01: onSOH();	break;
-		case 0x02: onSTX(); break;
-		case 0x03: onETX(); break;
-		case 0x04: onEOT(); break;
-		case 0x05: onENQ(); break;
-		case 0x06: onACK(); break;
-		case 0x07: onBEL(); break;
-		case 0x08: onBS(); break;
-		case 0x09: onHT(); break;
-		case 0x0A: onLF(); break;
-		case 0x0B: onVT(); break;
-		case 0x0C: onFF(); break;
-		case 0x0D: onCR(); break;
-		case 0x0E: onSO(); break;
-		case 0x0F: onSI(); break;
-		case 0x10: onDLE(); break;
-		case 0x11: onDC1(); break;
-		case 0x12: onDC2(); break;
-		case 0x13: onDC3(); break;
-		case 0x14: onDC4(); break;
-		case 0x15: onNAK(); break;
-		case 0x16: onSYN(); break;
-		case 0x17: onETB(); break;
-		case 0x18: onCAN(); break;
-		case 0x19: onEM(); break;
-		case 0x1A: onSUB(); break;
-		case 0x1B: onESC(); break;
-		case 0x1C: onFS(); break;
-		case 0x1D: onGS(); break;
-		case 0x1E: onRS(); break;
-		case 0x1F: onUS(); break;
-		default:
-			// Must not occur (out of range)
-			break;
-	}
+	m_utf8 = utf8;
+	m_utf8Decoder.reset();
 }
 
-void TerminalParser::onCAN()
+void TerminalParserBase::Set8BitControls(bool enable)
 {
-	Transition(WXTP_STATE_GROUND);
+	m_table = &s_tables[enable ? 1 : 0];
+	m_groundControlMask = enable ? 0x60 : 0xE0;
 }
 
-void TerminalParser::onSUB()
-{
-	Transition(WXTP_STATE_GROUND);
-}
-
-void TerminalParser::onESC()
+/**
+ * Test if a char must be processed by the state machine when received in ground state.
+ * That is C0 (0x00-0x1F) control codes, DEL (0x7F) and C1 (0x80-0x9F) control codes if enabled.
+ * Note: (c & 0xE0)==0 matches exactly 0x00-0x1F and (c & 0x60)==0 matches exactly 0x00-0x1F and 0x80-0x9F.
+ */
+static inline bool IsGroundControl(unsigned char c, unsigned char controlMask)
 {
-	Transition(WXTP_STATE_ESCAPE);
+	return (c & controlMask) == 0 || c == 0x7F;
 }
 
-void TerminalParser::executeC1ControlCode(unsigned char c)
+#if defined(__AVX2__) || defined(__SSE2__)
+/**
+ * Index of the lowest bit set in a (non-null) mask.
+ */
+static inline unsigned int LowestBitIndex(unsigned int mask)
 {
-	switch(c)
+#if defined(__GNUC__)
+	return __builtin_ctz(mask);
+#else
+	unsigned int n = 0;
+	while((mask & 1) == 0)
 	{
-		case 0x80: onPAD(); break;
-		case 0x81: onHOP(); break;
-		case 0x82: onBPH(); break;
-		case 0x83: onNBH(); break;
-		case 0x84: onIND(); break;
-		case 0x85: onNEL(); break;
-		case 0x86: onSSA(); break;
-		case 0x87: onESA(); break;
-		case 0x88: onHTS(); break;
-		case 0x89: onHTJ(); break;
-		case 0x8A: onVTS(); break;
-		case 0x8B: onPLD(); break;
-		case 0x8C: onPLU(); break;
-		case 0x8D: onRI(); break;
-		case 0x8E: onSS2(); break;
-		case 0x8F: onSS3(); break;
-		case 0x90: onDCS(); break;
-		case 0x91: onPU1(); break;
-		case 0x92: onPU2(); break;
-		case 0x93: onSTS(); break;
-		case 0x94: onCCH(); break;
-		case 0x95: onMW(); break;
-		case 0x96: onSPA(); break;
-		case 0x97: onEPA(); break;
-		case 0x98: onSOS(); break;
-		case 0x99: onSGCI(); break;
-		case 0x9A: onSCI(); break;
-		case 0x9B: onCSI(); break;
-		case 0x9C: onST(); break;
-		case 0x9D: onOSC(); break;
-		case 0x9E: onPM(); break;
-		case 0x9F: onAPC(); break;
-		default:
-			// Must not occur (out of range)
-			break;		
+		mask >>= 1;
+		++n;
 	}
+	return n;
+#endif
 }
+#endif
 
-void TerminalParser::onDCS()
+/**
+ * Find the next char which must be processed by the state machine in ground state.
+ * Scan blocks of 32 (AVX2) or 16 (SSE2) chars at once when available,
+ * the tail (or the whole buffer without SIMD support) is scanned char by char.
+ * \return Pointer to the first control char, or end if none.
+ */
+const unsigned char* TerminalParserBase::FindGroundControl(const unsigned char* buff, const unsigned char* end, unsigned char controlMask)
 {
-	Transition(WXTP_STATE_DCS_ENTRY);
+#if defined(__AVX2__)
+	const __m256i ctlMask = _mm256_set1_epi8(controlMask);
+	const __m256i del     = _mm256_set1_epi8(0x7F);
+	const __m256i zero    = _mm256_setzero_si256();
+	while(end - buff >= 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)buff);
+		__m256i m = _mm256_or_si256(
+						_mm256_cmpeq_epi8(_mm256_and_si256(v, ctlMask), zero),
+						_mm256_cmpeq_epi8(v, del));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+		if(mask)
+			return buff + LowestBitIndex(mask);
+		buff += 32;
+	}
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+	const __m128i ctlMask16 = _mm_set1_epi8(controlMask);
+	const __m128i del16     = _mm_set1_epi8(0x7F);
+	const __m128i zero16    = _mm_setzero_si128();
+	while(end - buff >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)buff);
+		__m128i m = _mm_or_si128(
+						_mm_cmpeq_epi8(_mm_and_si128(v, ctlMask16), zero16),
+						_mm_cmpeq_epi8(v, del16));
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+		if(mask)
+			return buff + LowestBitIndex(mask);
+		buff += 16;
+	}
+#endif
+	while(buff < end && !IsGroundControl(*buff, controlMask))
+		++buff;
+	return buff;
 }
 
-void TerminalParser::onSOS()
+void TerminalParserBase::Clear()
 {
-	Transition(WXTP_STATE_SOS_PM_APC_STRING);
+	m_collected.clear();
+	m_params.clear();
+	m_subParams = 0;
 }
 
-void TerminalParser::onCSI()
+size_t TerminalParserBase::Decode(const unsigned char* in, size_t len, char32_t* out)
 {
-	Transition(WXTP_STATE_CSI_ENTRY);
-}
+	if(m_utf8)
+		return m_utf8Decoder.decode(in, len, out);
 
-void TerminalParser::onST()
-{
-	Transition(WXTP_STATE_GROUND);
+	// ISO 8859-1 chars are their own code points.
+	for(size_t n=0; n<len; ++n)
+		out[n] = in[n];
+	return len;
 }
 
-void TerminalParser::onOSC()
-{
-	Transition(WXTP_STATE_OSC_STRING);
-}
 
-void TerminalParser::onPM()
-{
-	Transition(WXTP_STATE_SOS_PM_APC_STRING);
-}
+//
+// TerminalUTF8Decoder
+//
+// Bytes are first mapped to a class, then the DFA goes from state to state by class.
+// States and classes are the ones of http://bjoern.hoehrmann.de/utf-8/decoder/dfa/
+// so the lead byte payload is (0xFF >> class) & byte.
+//
 
-void TerminalParser::onAPC()
+namespace
 {
-	Transition(WXTP_STATE_SOS_PM_APC_STRING);
-}
-
-void TerminalParser::Clear()
+enum
 {
-	m_collected.clear();
-	m_params.clear();
-}
-
-void TerminalParser::Collect(unsigned char c)
+	UTF8_ACCEPT = 0,  // Between two sequences
+	UTF8_REJECT,      // Invalid byte
+	UTF8_CONT1,       // Expecting 1 continuation byte (80-BF)
+	UTF8_CONT2,       // Expecting 2 continuation bytes (80-BF)
+	UTF8_CONT3,       // Expecting 3 continuation bytes (80-BF)
+	UTF8_E0,          // After E0, expecting A0-BF (no overlong)
+	UTF8_ED,          // After ED, expecting 80-9F (no surrogate)
+	UTF8_F0,          // After F0, expecting 90-BF (no overlong)
+	UTF8_F4,          // After F4, expecting 80-8F (up to U+10FFFF)
+	UTF8_STATE_COUNT
+};
+
+struct TerminalUTF8Table
 {
-	m_collected.push_back(c);
-}
+	unsigned char classes[256];
+	unsigned char transitions[UTF8_STATE_COUNT][12];
 
-void TerminalParser::Param(unsigned char c)
-{
-	if( c == ';' ) // 0x3B
+	constexpr TerminalUTF8Table():
+	classes(),
+	transitions()
 	{
-		m_params.push_back(0);
+		setClass(0x00, 0x7F, 0);
+		setClass(0x80, 0x8F, 1);
+		setClass(0x90, 0x9F, 9);
+		setClass(0xA0, 0xBF, 7);
+		setClass(0xC0, 0xC1, 8);
+		setClass(0xC2, 0xDF, 2);
+		setClass(0xE0, 0xE0, 10);
+		setClass(0xE1, 0xEC, 3);
+		setClass(0xED, 0xED, 4);
+		setClass(0xEE, 0xEF, 3);
+		setClass(0xF0, 0xF0, 11);
+		setClass(0xF1, 0xF3, 6);
+		setClass(0xF4, 0xF4, 5);
+		setClass(0xF5, 0xFF, 8);
+
+		// All other transitions are UTF8_REJECT.
+		for(int state=0; state<UTF8_STATE_COUNT; ++state)
+			for(int cls=0; cls<12; ++cls)
+				transitions[state][cls] = UTF8_REJECT;
+
+		transitions[UTF8_ACCEPT][0] = UTF8_ACCEPT;
+		transitions[UTF8_ACCEPT][2] = UTF8_CONT1;
+		transitions[UTF8_ACCEPT][3] = UTF8_CONT2;
+		transitions[UTF8_ACCEPT][6] = UTF8_CONT3;
+		transitions[UTF8_ACCEPT][10] = UTF8_E0;
+		transitions[UTF8_ACCEPT][4] = UTF8_ED;
+		transitions[UTF8_ACCEPT][11] = UTF8_F0;
+		transitions[UTF8_ACCEPT][5] = UTF8_F4;
+		setContinuation(UTF8_CONT1, 1, 7, 9, UTF8_ACCEPT);
+		setContinuation(UTF8_CONT2, 1, 7, 9, UTF8_CONT1);
+		setContinuation(UTF8_CONT3, 1, 7, 9, UTF8_CONT2);
+		setContinuation(UTF8_E0, 7, 7, 7, UTF8_CONT1);
+		setContinuation(UTF8_ED, 1, 9, 9, UTF8_CONT1);
+		setContinuation(UTF8_F0, 7, 9, 9, UTF8_CONT2);
+		setContinuation(UTF8_F4, 1, 1, 1, UTF8_CONT2);
 	}
-	else if( c >= '0' && c <= '9' ) // 0x30 - 0x39
+
+	constexpr void setClass(int first, int last, int cls)
 	{
-		if(m_params.empty())
-			m_params.push_back(0);
-		m_params.back() = m_params.back() * 10 + (c - '0');
+		for(int c=first; c<=last; ++c)
+			classes[c] = (unsigned char)cls;
 	}
-}
 
+	/** Set the accepted continuation byte classes (up to three) of a state. */
+	constexpr void setContinuation(int state, int cls1, int cls2, int cls3, int next)
+	{
+		transitions[state][cls1] = (unsigned char)next;
+		transitions[state][cls2] = (unsigned char)next;
+		transitions[state][cls3] = (unsigned char)next;
+	}
+};
 
+constexpr TerminalUTF8Table s_utf8Table;
 
-
-void TerminalParser::DcsHook()
-{
-	/* TODO DCS is not implemented yet. */
-}
-
-void TerminalParser::DcsUnhook()
-{
-	/* TODO DCS is not implemented yet. */
-}
-
-void TerminalParser::DcsPut(unsigned char c)
-{
-	/* TODO DCS is not implemented yet. */
-}
-
-void TerminalParser::onOSC(unsigned short command, const std::vector<unsigned char>& params)
+#if defined(__AVX2__) || defined(__SSE2__)
+/**
+ * Widen 16 ASCII chars to code points.
+ */
+inline void WidenASCII(__m128i v, char32_t* out)
 {
-	
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_unpacklo_epi8(v, zero);
+	__m128i hi = _mm_unpackhi_epi8(v, zero);
+	_mm_storeu_si128((__m128i*)(out),      _mm_unpacklo_epi16(lo, zero));
+	_mm_storeu_si128((__m128i*)(out + 4),  _mm_unpackhi_epi16(lo, zero));
+	_mm_storeu_si128((__m128i*)(out + 8),  _mm_unpacklo_epi16(hi, zero));
+	_mm_storeu_si128((__m128i*)(out + 12), _mm_unpackhi_epi16(hi, zero));
 }
+#endif
+} // namespace
 
-void TerminalParser::onCSI(unsigned char command, const std::vector<unsigned short>& params, const std::vector<unsigned char>& collect)
+size_t TerminalUTF8Decoder::decode(const unsigned char* in, size_t len, char32_t* out)
 {
-	// TODO Add vector size test for each command and error handling if not.
-	switch(command)
+	char32_t* start = out;
+	const unsigned char* end = in + len;
+	unsigned int state = _state;
+	char32_t codePoint = _codePoint;
+	while(in < end)
 	{
-		case '@': onICH(params.empty()?1:params[0]); break;
-		case 'A': onCUU(params.empty()?1:params[0]); break;
-		case 'B': onCUD(params.empty()?1:params[0]); break;
-		case 'C': onCUF(params.empty()?1:params[0]); break;
-		case 'D': onCUB(params.empty()?1:params[0]); break;
-		case 'E': onCNL(params.empty()?1:params[0]); break;
-		case 'F': onCPL(params.empty()?1:params[0]); break;
-		case 'G': onCHA(params.empty()?1:params[0]); break;
-		case 'H': onCUP(params.size()<1?1:params[0], params.size()<2?1:params[1]); break;
-		case 'I': onCHT(params.empty()?1:params[0]); break;
-		case 'J':
-			if(collect.size()>0 && collect[0]=='?')
-				onDECSED(params.empty()?0:params[0]);
-			else
-				onED(params.empty()?0:params[0]);
-			break;
-		case 'K':
-			if(collect.size()>0 && collect[0]=='?')
-				onDECSEL(params.empty()?0:params[0]);
-			else
-				onEL(params.empty()?0:params[0]);
-			break;
-		case 'L': onIL(params.empty()?1:params[0]); break;
-		case 'M': onDL(params.empty()?1:params[0]); break;
-		case 'P': onDCH(params.empty()?1:params[0]); break;
-		case 'S': onSU(params.empty()?1:params[0]); break;
-		case 'T': onSD(params.empty()?1:params[0]); break;
-		case 'X': onECH(params.empty()?1:params[0]); break;
-		case 'Z': onCBT(params.empty()?1:params[0]); break;
-		case '`': onHPA(params); break;
-		case 'a': onHPR(params); break;
-		case 'd': onVPA(params); break;
-		case 'e': onVPR(params); break;
-		case 'f': onHVP(params.size()<1?1:params[0], params.size()<2?1:params[1]); break;
-		case 'g': onTBC(params.empty()?0:params[0]); break;
-		case 'h':
-			if(collect.size()>0 && collect[0]=='?')
-				onDECSET(params);
-			else
-				onSM(params);
-			break;
-		case 'i':
-			if(collect.size()>0 && collect[0]=='?')
-				onDECMC(params);
-			else
-				onMC(params);
-			break;
-		case 'l':
-			if(collect.size()>0 && collect[0]=='?')
-				onDECRST(params);
-			else
-				onRM(params);
-			break;
-		case 'm': onSGR(params); break;
-		case 'n':
-			if(collect.size()>0 && collect[0]=='?')
-				onDECDSR(params[0]);
-			else
-				onDSR(params[0]);
-			break;
-		case 'p':
-			if(collect.size()==1)
-			{
-				if(collect[0]=='!')
-					onDECSTR();
-				else if(collect[0]=='"')
-					onDECSCL(params[0], params[1]);
-			}
-			else if(collect.size()==2)
-			{
-				if(collect[0]=='?' && collect[0]=='$')
-					onDECRQM(params[0]);
-			}
-			break;
-		case 'q':
-			if(collect.size()==0)
-				onDECLL(params[0]);
-			else if(collect.size()==1)
-			{
-				if(collect[0]==' ')
-					onDECSCUSR(params[0]);
-				else if(collect[0]=='"')
-					onDECSCA(params[0]);
-			}
-			break;
-		case 'r':
-			if(collect.size()==0)
-				onDECSTBM(params[0], params[1]);
-			else if(collect.size()==1)
-			{
-				if(collect[0]=='?')
-					onRDECPMV(params);
-				else if(collect[0]=='$')
-					onDECCARA(params);
-			}
-			break;
-		case 's':
-			if(collect.size()==0)
-			{
-				if(params.size()==0)
-					onANSISC();
-				else if(params.size()>=2)
-					onDECSLRM(params[0], params[1]);
-			}
-			else if(collect[0]=='?')
-			{
-				onSDECPMV(params);
-			}
-			break;
-		case 't':
-			if(collect.size()==0)
-			{
-				if(params.size()==1)
-					onWindowManip(params[0]);
-				else if(params.size()==2)
-					onWindowManip(params[0], params[1]);
-				else if(params.size()==3)
-					onWindowManip(params[0], params[1], params[2]);
-				else
-					onDECRARA(params);
-			}
-			else if(collect.size()==1)
-			{
-				if(collect[0]==' ')
-					onDECSWBV(params[0]);
-			}
-			break;
-		case 'u':
-			if(collect.size()==0)
-			{
-				onANSIRC();
-			}
-			else if(collect[0]==' ')
-			{
-				onDECSMBV(params[0]);
-			}
-			break;
-		case 'v':
-			if(collect.size()==1)
-			{
-				if(collect[0]==' ')
-				{
-					onDECCRA(params);
-				}
-			}			 
-			break;
-		case 'w':
-			if(collect.size()==1)
-			{
-				if(collect[0]=='`')
-				{
-					onDECEFR(params[0], params[1], params[2], params[3]);
-				}
-			}
-			break;
-		case 'x':
-			if(collect.size()==0)
-			{
-				onDECREQTPARM(params[0]);
-			}
-			else if(collect[0]=='*')
-			{
-				onDECSACE(params[0]);
-			}
-			else if(collect[0]=='$')
-			{
-				onDECFRA(params[0], params[1], params[2], params[3], params[4]);
-			}
-			break;
-		case 'y':
-			if(collect.size()==1)
-			{
-				if(collect[0]=='*')
-				{
-					onDECRQCRA(params[0], params[1], params[2], params[3], params[5], params[6]);
-				}
-			}
-			break;
-		case 'z':
-			if(collect.size()==1)
+#if defined(__AVX2__) || defined(__SSE2__)
+		// Fast path: ASCII chars between two sequences, by blocks of 16.
+		// out has room for them as each byte gives at most one code point.
+		if(state == UTF8_ACCEPT)
+		{
+			while(end - in >= 16)
 			{
-				if(collect[0]=='`')
-				{
-					onDECELR(params[0], params[1]);
-				}
-				else if(collect[0]=='$')
+				__m128i v = _mm_loadu_si128((const __m128i*)in);
+				unsigned int mask = (unsigned int)_mm_movemask_epi8(v);
+				WidenASCII(v, out);
+				if(mask != 0)
 				{
-					onDECERA(params[0], params[1], params[2], params[3]);
+					// Keep the ASCII prefix only.
+					unsigned int ascii = LowestBitIndex(mask);
+					in += ascii;
+					out += ascii;
+					break;
 				}
+				in += 16;
+				out += 16;
 			}
-			break;
-		case '{':
-			if(collect.size()==1)
+			if(in == end)
+				break;
+		}
+#endif
+		// Run the DFA up to the next ASCII char between two sequences.
+		do
+		{
+			unsigned char c = *in;
+			// Complete 2 and 3 byte sequences which need no range check
+			// skip the table walk.
+			if(state == UTF8_ACCEPT)
 			{
-				if(collect[0]=='`')
+				if(c >= 0xC2 && c <= 0xDF && end - in >= 2 && (in[1] & 0xC0) == 0x80)
 				{
-					onDECSLE(params);
+					*out++ = ((char32_t)(c & 0x1F) << 6) | (in[1] & 0x3F);
+					in += 2;
+					continue;
 				}
-				else if(collect[0]=='$')
+				if(c >= 0xE1 && c <= 0xEF && c != 0xED && end - in >= 3 && ((in[1] & 0xC0) | ((in[2] & 0xC0) >> 2)) == 0xA0)
 				{
-					onDECSERA(params[0], params[1], params[2], params[3]);
+					*out++ = ((char32_t)(c & 0x0F) << 12) | ((char32_t)(in[1] & 0x3F) << 6) | (in[2] & 0x3F);
+					in += 3;
+					continue;
 				}
 			}
-			break;
-		case '|':
-			if(collect.size()==1)
+			unsigned int cls = s_utf8Table.classes[c];
+			unsigned int next = s_utf8Table.transitions[state][cls];
+			codePoint = (state != UTF8_ACCEPT) ? ((codePoint << 6) | (c & 0x3F)) : ((0xFF >> cls) & c);
+			if(next == UTF8_ACCEPT)
 			{
-				if(collect[0]=='`')
-				{
-					onDECRQLP(params[0]);
-				}
+				*out++ = codePoint;
 			}
-			break;
-		case '}':
-			if(collect.size()==1)
+			else if(next == UTF8_REJECT)
 			{
-				if(collect[0]=='`')
+				*out++ = REPLACEMENT_CHARACTER;
+				next = UTF8_ACCEPT;
+				// A byte breaking a sequence starts the next one.
+				if(state != UTF8_ACCEPT)
 				{
-					onDECIC(params[0]);
+					state = next;
+					continue;
 				}
 			}
-			break;			
-		case '~':
-			if(collect.size()==1)
-			{
-				if(collect[0]=='`')
-				{
-					onDECDC(params[0]);
-				}
-			}
-			break;
-		default:
-			/* TODO CSI interpreting is not fully implemented yet. */
-			std::cout << "CSI " << (char)command << std::endl; 
-			break;
-	}	
-}
-
-void TerminalParser::onESC(unsigned char command)
-{
-	switch(command)
-	{
-		// Traditionnal commands:
-		case 'D': onIND(); break;
-		case 'E': onNEL(); break;
-		case 'H': onHTS(); break;
-		case 'M': onRI(); break;
-		case 'N': onSS2(); break;
-		case 'O': onSS3(); break;
-		case 'P': onDCS(); break;
-		case 'V': onSPA(); break;
-		case 'W': onEPA(); break;
-		case 'X': onSOS(); break;
-		case 'Z': onSCI(); break; // TODO Validate that!!
-		case '\\': onST(); break;
-		case '^': onPM(); break;
-		case '_': onAPC(); break;
-		
-		// Advanced commands:
-		case '6': onDECBI(); break;
-		case '7': onDECSC(); break;
-		case '8': onDECRC(); break;
-		case '9': onDECFI(); break;
-		case '=': onDECKPAM(); break;
-		case '>': onDECKPNM(); break;
-		case 'c': onRIS(); break;
-		case 'n': onLS2(); break;
-		case 'o': onLS3(); break;
-		case '|': onLS3R(); break;
-		case '}': onLS2R(); break;
-		case '~': onLS1R(); break;
-
-		// Following commands should be processed elsewhere:			
-		case '[': // CSI (Control Sequence Introducer) : Should not pass here !
-		case ']': // OSC (Operating System Command) : Should not pass here !
-			break;
-		
-		// HP Extensions:
-		case 'F':
-		case 'l':
-		case 'm':
-			// TODO Should I support HP extensions ???
-			break;
-			
-		default:
-			break;
-	}
-}
-
-void TerminalParser::onESC(unsigned char command, unsigned char param)
-{
-	switch(command)
-	{
-	case ' ': // Conformance and control character set
-		switch(param)
-		{
-			case 'F': onS7C1T(); break;
-			case 'G': onS8C1T(); break;
-			case 'L': onANSIconf1(); break;
-			case 'M': onANSIconf2(); break;
-			case 'N': onANSIconf3(); break;
-			default:
-				// Undefined conformance.
-				break;
-		}
-		break;
-	case '#': // DEC specific adjustements
-		switch(param)
-		{
-			case '3': onDECDHLth(); break;
-			case '4': onDECDHLbh(); break;
-			case '5': onDECSWL(); break;
-			case '6': onDECDWL(); break;
-			case '8': onDECALN(); break;
-			default:
-				break;
+			state = next;
+			++in;
 		}
-		break;
-	case '%': // Character set
-		switch(param)
-		{
-			case '@': onISO8859_1(); break;
-			case 'G': onUTF_8(); break;
-			default:
-				break;
-		}
-		break;
-	case '(': // Designate G0 charset
-	    onSCS(0, param);
-	    break;
-	case ')': // Designate G1 charset
-	case '-':
-	    onSCS(1, param);
-	    break;
-	case '*': // Designate G2 charset
-	case '.':
-	    onSCS(2, param);
-	    break;
-	case '+': // Designate G3 charset
-	case '/':
-	    onSCS(3, param);
-	    break;
-	default:
-		// Invalid, TODO should I call onESC(...) with one char ? 
-		break;
+		while(in < end && (state != UTF8_ACCEPT || *in >= 0x80));
 	}
+	_state = state;
+	_codePoint = codePoint;
+	return out - start;
 }
-
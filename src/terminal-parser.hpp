@@ -21,28 +21,425 @@ wxTerminal is free software: you can redistribute it and/or modify it
 #define _TERMINAL_PARSER_HPP_
 
 
+#include <cstddef>
 #include <vector>
 #include <list>
 #include <set>
+#include <iostream>
 
 
-class TerminalParser
+/**
+ * Read-only view over a sequence of parser values (parameters, intermediates).
+ * Cheap to copy, it is passed by value to handlers.
+ * Reading past the end is allowed and returns a default (null) value,
+ * as omitted parameters default to 0.
+ */
+template<typename T>
+class TerminalParserSpan
+{
+public:
+	TerminalParserSpan():_data(NULL), _size(0){}
+	TerminalParserSpan(const T* data, size_t size):_data(data), _size(size){}
+
+	size_t size()const{return _size;}
+	bool empty()const{return _size==0;}
+
+	const T* begin()const{return _data;}
+	const T* end()const{return _data+_size;}
+
+	T operator[](size_t n)const{return n<_size ? _data[n] : T();}
+
+protected:
+	const T* _data;
+	size_t _size;
+};
+
+/**
+ * View over the numeric parameters of a sequence.
+ * Parameters separated by a colon instead of a semicolon are sub-parameters
+ * of the previous one, like in SGR "38:2::R:G:B" or "4:3".
+ * A group is a parameter followed by its sub-parameters.
+ */
+class TerminalParserParams : public TerminalParserSpan<unsigned short>
+{
+public:
+	TerminalParserParams():_subs(0){}
+	TerminalParserParams(const unsigned short* data, size_t size, unsigned int subs):
+		TerminalParserSpan<unsigned short>(data, size), _subs(subs){}
+
+	/** Test if the parameter n is a sub-parameter (follows a colon). */
+	bool isSub(size_t n)const{return n<_size && ((_subs>>n) & 1);}
+
+	/** Test if there is any sub-parameter. */
+	bool hasSubs()const{return _subs!=0;}
+
+	/** Number of parameters of the group starting at n (the parameter and its sub-parameters). */
+	size_t groupSize(size_t n)const
+	{
+		size_t end = n+1;
+		while(isSub(end))
+			++end;
+		return end-n;
+	}
+
+protected:
+	/** Sub-parameter flags, bit n is set when parameter n follows a colon. */
+	unsigned int _subs;
+};
+/** View over the collected private marker and intermediate chars of a sequence. */
+typedef TerminalParserSpan<unsigned char> TerminalParserIntermediates;
+/** View over a chunk of OSC or DCS payload. */
+typedef TerminalParserSpan<unsigned char> TerminalParserPayload;
+/** View over a run of printable text, as Unicode code points. */
+typedef TerminalParserSpan<char32_t> TerminalParserText;
+
+
+/**
+ * Incremental UTF-8 decoder, driven by a DFA (after Bjoern Hoehrmann's decoder).
+ * Sequences may be split across calls, the decoding state is kept between them.
+ * Each maximal invalid subsequence (overlong forms, surrogates, values above U+10FFFF,
+ * stray or missing continuation bytes) is replaced by one U+FFFD.
+ */
+class TerminalUTF8Decoder
+{
+public:
+	/** Replacement character, substituted to invalid input. */
+	enum { REPLACEMENT_CHARACTER = 0xFFFD };
+
+	TerminalUTF8Decoder():_codePoint(0), _state(0){}
+
+	/** Drop any pending incomplete sequence. */
+	void reset(){_state = 0;}
+
+	/** Test if an incomplete sequence is pending. */
+	bool pending()const{return _state != 0;}
+
+	/**
+	 * Decode a buffer.
+	 * \param out Decoded code points, must have room for len+1 values
+	 * (one more for the replacement of a sequence left incomplete by the previous call).
+	 * \return Number of decoded code points.
+	 */
+	size_t decode(const unsigned char* in, size_t len, char32_t* out);
+
+protected:
+	/** Code point being decoded. */
+	char32_t _codePoint;
+	/** DFA state, 0 when between two sequences. */
+	unsigned char _state;
+};
+
+/**
+ * Fixed-capacity inline storage for parser values, never allocating.
+ * Values pushed when full are dropped and the buffer is marked as overflowed.
+ */
+template<typename T, size_t N>
+class TerminalParserBuffer
+{
+public:
+	TerminalParserBuffer():_size(0), _overflow(false){}
+
+	size_t size()const{return _size;}
+	bool empty()const{return _size==0;}
+	bool overflow()const{return _overflow;}
+
+	void clear(){_size = 0; _overflow = false;}
+
+	void push_back(T value)
+	{
+		if(_size<N)
+			_data[_size++] = value;
+		else
+			_overflow = true;
+	}
+
+	T& back(){return _data[_size-1];}
+
+	const T* data()const{return _data;}
+
+	T operator[](size_t n)const{return n<_size ? _data[n] : T();}
+
+	operator TerminalParserSpan<T>()const{return TerminalParserSpan<T>(_data, _size);}
+
+protected:
+	T _data[N];
+	size_t _size;
+	bool _overflow;
+};
+
+
+/**
+ * Parser internals which do not depend on the handler class:
+ * states and actions of the state machine, transition tables and sequence buffers.
+ */
+class TerminalParserBase
+{
+public:
+	/** Default maximum size of an OSC or DCS payload. */
+	enum { DEFAULT_PAYLOAD_LIMIT = 1024*1024 };
+
+	/**
+	 * Set the maximum size of an OSC or DCS payload.
+	 * Bytes beyond are dropped and the payload is reported as truncated.
+	 */
+	void SetPayloadLimit(size_t limit){m_payloadLimit = limit;}
+	size_t GetPayloadLimit()const{return m_payloadLimit;}
+
+	/**
+	 * Select the input encoding of printable chars, UTF-8 or ISO 8859-1 (default).
+	 * Also changed by ESC % G and ESC % @.
+	 */
+	void SetUTF8(bool utf8);
+	bool IsUTF8()const{return m_utf8;}
+
+	/**
+	 * Enable recognition of 8-bit C1 controls (0x80-0x9F).
+	 * Disabled by default, so these bytes are text (like UTF-8 continuation bytes).
+	 * Also changed by S8C1T and S7C1T.
+	 */
+	void Set8BitControls(bool enable);
+	bool Get8BitControls()const{return m_groundControlMask == 0x60;}
+
+protected:
+	TerminalParserBase();
+
+	enum WXTP_STATE
+	{
+		WXTP_STATE_GROUND,
+		WXTP_STATE_ESCAPE,
+		WXTP_STATE_ESCAPE_INTERMEDIATE,
+		WXTP_STATE_CSI_ENTRY,
+		WXTP_STATE_CSI_PARAM,
+		WXTP_STATE_CSI_INTERMEDIATE,
+		WXTP_STATE_CSI_IGNORE,
+		WXTP_STATE_DCS_ENTRY,
+		WXTP_STATE_DCS_PARAM,
+		WXTP_STATE_DCS_INTERMEDIATE,
+		WXTP_STATE_DCS_PASSTHROUGH,
+		WXTP_STATE_DCS_IGNORE,
+		WXTP_STATE_OSC_ENTRY,
+		WXTP_STATE_OSC_STRING,
+		WXTP_STATE_SOS_PM_APC_STRING,
+
+		WXTP_STATE_COUNT
+	};
+
+	/**
+	 * Actions done by the state machine, on char reception or on state entry/exit.
+	 */
+	enum WXTP_ACTION
+	{
+		WXTP_ACTION_NONE,         // Ignore
+		WXTP_ACTION_EXECUTE,      // Execute C0 control code
+		WXTP_ACTION_EXECUTE_C1,   // Execute C1 control code
+		WXTP_ACTION_PRINT,        // Print
+		WXTP_ACTION_ESC_COLLECT,  // Collect first escaped char
+		WXTP_ACTION_COLLECT,      // Collect
+		WXTP_ACTION_PARAM,        // Param
+		WXTP_ACTION_ESC_DISPATCH, // One-char esc_dispatch
+		WXTP_ACTION_ESC2_DISPATCH,// Two-char esc_dispatch
+		WXTP_ACTION_CSI_DISPATCH, // csi_dispatch
+		WXTP_ACTION_PUT,          // DCS put
+		WXTP_ACTION_CLEAR,        // Clear (state entry)
+		WXTP_ACTION_HOOK,         // DCS hook (state entry)
+		WXTP_ACTION_UNHOOK,       // DCS unhook (state exit)
+		WXTP_ACTION_OSC_PUT,      // OSC put
+		WXTP_ACTION_OSC_END,      // OSC end (state exit)
+		// Transition table entries hold actions on 4 bits, following ones are only state entry or exit actions.
+		WXTP_ACTION_OSC_START     // OSC start (state entry)
+	};
+
+	/** Transition tables, generated at compile time, without and with 8-bit C1 controls. */
+	struct Table;
+	static const Table s_tables[2];
+
+	/**
+	 * Find the next char which must be processed by the state machine in ground state.
+	 * \param controlMask Mask of bits which are all null for control chars, see m_groundControlMask.
+	 * \return Pointer to the first control char, or end if none.
+	 */
+	static const unsigned char* FindGroundControl(const unsigned char* buff, const unsigned char* end, unsigned char controlMask);
+
+	/**
+	 * Decode a run of printable chars to code points, with the current input encoding.
+	 * \param out Decoded code points, must have room for len+1 values.
+	 * \return Number of decoded code points.
+	 */
+	size_t Decode(const unsigned char* in, size_t len, char32_t* out);
+
+	/**
+	 * Clear
+	 */
+	void Clear();
+
+	/**
+	 * Collect the current character.
+	 */
+	void Collect(unsigned char c){m_collected.push_back(c);}
+
+	/**
+	 * PARAM
+	 */
+	void Param(unsigned char c);
+	
+
+	/**
+	 * Start a new OSC or DCS payload.
+	 */
+	void PayloadStart(){m_payloadSize = 0; m_payloadTruncated = false;}
+
+	/**
+	 * Account for a chunk of payload.
+	 * \return Number of bytes to deliver, that is len clipped to the payload limit.
+	 */
+	size_t PayloadRoom(size_t len)
+	{
+		size_t room = m_payloadLimit - m_payloadSize;
+		if(len > room)
+		{
+			len = room;
+			m_payloadTruncated = true;
+		}
+		m_payloadSize += len;
+		return len;
+	}
+
+	/** Current state. */
+	WXTP_STATE m_state;
+
+	/** Current transition table. \see Set8BitControls */
+	const Table* m_table;
+
+	/**
+	 * Ground state control chars are those with all bits of this mask null (plus DEL).
+	 * 0xE0 for C0 only, 0x60 for C0 and C1.
+	 */
+	unsigned char m_groundControlMask;
+
+	/** UTF-8 input encoding. \see SetUTF8 */
+	bool m_utf8;
+
+	/** UTF-8 decoder of printable chars. */
+	TerminalUTF8Decoder m_utf8Decoder;
+
+	/** Maximum number of collected intermediate chars, extra ones are dropped. */
+	enum { MAX_INTERMEDIATES = 8 };
+
+	/** Maximum number of parameters, extra ones are dropped. Must fit in m_subParams bits. */
+	enum { MAX_PARAMS = 32 };
+
+	/** Collected private marker and intermediate chars. \see Collect(unsigned char) */
+	TerminalParserBuffer<unsigned char, MAX_INTERMEDIATES> m_collected;
+
+	/** Collected parameters. \see Param(unsigned char) */
+	TerminalParserBuffer<unsigned short, MAX_PARAMS> m_params;
+
+	/** Sub-parameter flags of m_params. \see TerminalParserParams::isSub */
+	unsigned int m_subParams;
+
+	/** Maximum size of an OSC or DCS payload. */
+	size_t m_payloadLimit;
+
+	/** Size of the current payload, up to m_payloadLimit. */
+	size_t m_payloadSize;
+
+	/** Set when some bytes of the current payload have been dropped. */
+	bool m_payloadTruncated;
+
+	/** Set when the current OSC has a command number, that is delivered. */
+	bool m_oscActive;
+
+	/** Command of the current OSC, for the default buffered delivery. */
+	unsigned short m_oscCommand;
+
+	/** OSC string for the default buffered delivery, its capacity is kept from one OSC to the next. */
+	std::vector<unsigned char> m_oscString;
+
+	/** First escaping character, if any. */
+	unsigned char m_escapedFirstChar;
+};
+
+/**
+ * Transition tables.
+ *
+ * Each [state][char] entry packs the action to do (high nibble) and the next state (low nibble),
+ * NO_TRANSITION meaning to stay in the current state.
+ * Actions done on state entry and exit are stored in their own per-state tables.
+ */
+struct TerminalParserBase::Table
+{
+	enum { NO_TRANSITION = 0x0F };
+
+	unsigned char transitions[WXTP_STATE_COUNT][256];
+	unsigned char entryActions[WXTP_STATE_COUNT];
+	unsigned char exitActions[WXTP_STATE_COUNT];
+
+	constexpr Table(bool c1Controls);
+
+	/** Set the action and next state for a range of chars (bounds included). */
+	constexpr void set(int state, int first, int last, int action, int next = NO_TRANSITION);
+};
+
+inline void TerminalParserBase::Param(unsigned char c)
+{
+	if( c == ';' || c == ':' ) // 0x3B, 0x3A
+	{
+		// An empty leading parameter is a parameter too.
+		if(m_params.empty())
+			m_params.push_back(0);
+		m_params.push_back(0);
+		if( c == ':' && !m_params.overflow() )
+			m_subParams |= 1u << (m_params.size()-1);
+	}
+	else if( c >= '0' && c <= '9' ) // 0x30 - 0x39
+	{
+		if(m_params.empty())
+			m_params.push_back(0);
+		if(!m_params.overflow())
+		{
+			// Saturate instead of wrapping around.
+			unsigned int value = m_params.back() * 10u + (c - '0');
+			m_params.back() = value > 0xFFFF ? 0xFFFF : (unsigned short)value;
+		}
+	}
+}
+
+
+/**
+ * Terminal parser, dispatching statically to the handlers of Derived (CRTP).
+ *
+ * Derived shadows the handlers it is interested in, other ones keep the default behavior.
+ * As handlers are usually protected, Derived must declare TerminalParserT<Derived> as friend.
+ * Shadowing one overload of onESC, onCSI or onOSC hides the others,
+ * bring them back with a using declaration.
+ * \see TerminalParser for a variant with virtual handlers.
+ */
+template<class Derived>
+class TerminalParserT : public TerminalParserBase
 {
 public:
 
 	void Process(unsigned char c);
+
+	/**
+	 * Process a buffer of characters.
+	 * In ground state, runs of printable characters are decoded and delivered at once
+	 * through onPrintableText().
+	 */
+	void Process(const unsigned char* buff, size_t sz);
 	
 protected:
-	TerminalParser();
+	TerminalParserT(){}
 
 
 	/**
-	 * Receive a printable char, to print.
+	 * Receive a run of printable chars, to print.
+	 * Chars are decoded code points, from UTF-8 or ISO 8859-1 depending on the input encoding.
 	 */
-	virtual void onPrintableChar(unsigned char c){}
+	void onPrintableText(TerminalParserText text){}
 
-	virtual void onSP(){}
-	virtual void onDEL(){}	
+	void onSP(){}
+	void onDEL(){}	
 
 	/** Escape sequence control handlers  (other than C0 and C1)
 	 * EKI Should I support HP extensions ?
@@ -51,13 +448,305 @@ protected:
 	 * Receive an one-char ESC (escaped) command.
 	 * \param command Command character (first char after ESC command).
 	 */
-	virtual void onESC(unsigned char command);
+	void onESC(unsigned char command);
 	/**
 	 * Receive an two-char ESC (escaped) command.
 	 * \param command Command character (first char after ESC command).
 	 * \param param Parameter character (second char after ESC command).
 	 */
-	virtual void onESC(unsigned char command, unsigned char param);	
+	void onESC(unsigned char command, unsigned char param);	
+	void onS7C1T(){} // 7-bit controls
+	void onS8C1T(){} // 8-bit controls
+	void onANSIconf1(){} // Set ANSI conformance level 1  (vt100, 7-bit controls).
+	void onANSIconf2(){} // Set ANSI conformance level 2  (vt200).
+	void onANSIconf3(){} // Set ANSI conformance level 3  (vt300).
+	void onDECDHLth(){} // DEC double-height line, top half
+	void onDECDHLbh(){} // DEC double-height line, bottom half
+	void onDECSWL(){} // DEC single-width line
+	void onDECDWL(){} // DEC double-width line
+	void onDECALN(){} // DEC Screen Alignment Test
+	void onISO8859_1(){} // Select default character set. That is ISO 8859-1 (ISO 2022).
+	void onUTF_8(){} // Select UTF-8 character set (ISO 2022).
+	void onSCS(unsigned char id, unsigned char charset){} // Character Set Selection (SCS). Designate G(id) (G0...G3) Character Set (ISO 2022) 
+	void onDECBI(){} // Back Index, VT420 and up.
+	void onDECSC(){} // Save cursor
+	void onDECRC(){} // Restore cursor
+	void onDECFI(){} // Forward Index, VT420 and up.
+	void onDECKPAM(){} // Application Keypad
+	void onDECKPNM(){} // Normal Keypad
+	void onRIS(){} // Full Reset
+	void onLS2(){} // Invoke the G2 Character Set as GL.
+	void onLS3(){} // Invoke the G3 Character Set as GL.
+	void onLS1R(){} // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
+	void onLS2R(){} // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
+	void onLS3R(){} // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
+	/** \} */
+
+	
+	/** C0 Control code handlers
+	 * \{ */
+	/**
+	 * Execute C0 control code (0x00-0x1F)
+	 * http://en.wikipedia.org/wiki/C0_and_C1_control_codes
+	 */
+	void executeC0ControlCode(unsigned char c);
+	void onNUL(){}  // 0x00
+	void onSOH(){}  // 0x01
+	void onSTX(){}  // 0x02
+	void onETX(){}  // 0x03
+	void onEOT(){}  // 0x04
+	void onENQ(){}  // 0x05
+	void onACK(){}  // 0x06
+	void onBEL(){}  // 0x07
+	void onBS(){}   // 0x08
+	void onHT(){}   // 0x09
+	void onLF(){}   // 0x0A
+	void onVT(){}   // 0x0B
+	void onFF(){}   // 0x0C
+	void onCR(){}   // 0x0D
+	void onSO(){}   // 0x0E
+	void onSI(){}   // 0x0F
+	void onDLE(){}  // 0x10
+	void onDC1(){}  // 0x11
+	void onDC2(){}  // 0x12
+	void onDC3(){}  // 0x13
+	void onDC4(){}  // 0x14
+	void onNAK(){}  // 0x15
+	void onSYN(){}  // 0x16
+	void onETB(){}  // 0x17
+	void onCAN();   // 0x18
+	void onEM(){}   // 0x19
+	void onSUB();   // 0x1A
+	void onESC();   // 0x1B
+	void onFS(){}   // 0x1C
+	void onGS(){}   // 0x1D
+	void onRS(){}   // 0x1E
+	void onUS(){}   // 0x1F
+	/** \} */
+
+	
+	/** C1 Control code handlers
+	 * \{ */
+	/**
+	 * Execute C1 control code (0x80-0x9F)
+	 * http://en.wikipedia.org/wiki/C0_and_C1_control_codes
+	 */
+	void executeC1ControlCode(unsigned char c);
+	void onPAD(){}  // 0x80
+	void onHOP(){}  // 0x81
+	void onBPH(){}  // 0x82
+	void onNBH(){}  // 0x83
+	void onIND(){}  // 0x84
+	void onNEL(){}  // 0x85
+	void onSSA(){}  // 0x86
+	void onESA(){}  // 0x87
+	void onHTS(){}  // 0x88
+	void onHTJ(){}  // 0x89
+	void onVTS(){}  // 0x8A
+	void onPLD(){}  // 0x8B
+	void onPLU(){}  // 0x8C
+	void onRI(){}   // 0x8D
+	void onSS2(){}  // 0x8E
+	void onSS3(){}  // 0x8F
+	void onDCS();   // 0x90
+	void onPU1(){}  // 0x91
+	void onPU2(){}  // 0x92
+	void onSTS(){}  // 0x93
+	void onCCH(){}  // 0x94
+	void onMW(){}   // 0x95
+	void onSPA(){}  // 0x96
+	void onEPA(){}  // 0x97
+	void onSOS();   // 0x98
+	void onSGCI(){} // 0x99
+	void onSCI(){}  // 0x9A
+	void onCSI();   // 0x9B
+	void onST();    // 0x9C
+	void onOSC();   // 0x9D
+	void onPM();    // 0x9E
+	void onAPC();   // 0x9F
+	/** \} */
+	
+
+	/** CSI Control handlers
+	 * \{ */
+	/**
+	 * Receive a CSI (Control Sequence Introducer) command.
+	 * \param command Command character (last character of CSI sequence).
+	 * \param params  Optionnal parameter sequence.
+     */
+	void onCSI(unsigned char command, TerminalParserParams params, TerminalParserIntermediates collect);
+	void onICH(unsigned short nb=1){} // Insert P s (Blank) Character(s) (default = 1)
+	void onCUU(unsigned short nb=1){} // Cursor Up P s Times (default = 1)
+	void onCUD(unsigned short nb=1){} // Cursor Down P s Times (default = 1)
+	void onCUF(unsigned short nb=1){} // Cursor Forward P s Times (default = 1)
+	void onCUB(unsigned short nb=1){} // Cursor Backward P s Times (default = 1)
+	void onCNL(unsigned short nb=1){} // Cursor Next Line P s Times (default = 1)
+	void onCPL(unsigned short nb=1){} // Cursor Preceding Line P s Times (default = 1)
+	void onCHA(unsigned short nb=1){} // Cursor Character Absolute [column] (default = [row,1]) // Moves the cursor to column n.
+	void onCUP(unsigned short row=1, unsigned short col=1){} // Cursor Position [row;column] (default = [1,1])
+	void onCHT(unsigned short nb=1){} // Cursor Forward Tabulation P s tab stops (default = 1)
+	void onED(unsigned short opt=1){}  // Erase in Display. 0 → Erase Below (default). 1 → Erase Above. 2 → Erase All. 3 → Erase Saved Lines (xterm).
+	void onDECSED(unsigned short opt=1){}  // Erase in Display. 0 → Selective Erase Below (default). 1 → Selective Erase Above. 2 → Selective Erase All. 3 → Selective Erase Saved Lines (xterm).
+	void onEL(unsigned short opt=0){}      // Erase in Line. 0 → Erase to Right (default). 1 → Erase to Left. 2 → Erase All.
+	void onDECSEL(unsigned short nb=0){}  // Erase in Line. 0 → Selective Erase to Right (default). 1 → Selective Erase to Left. 2 → Selective Erase All.
+	void onIL(unsigned short nb=1){}  // Insert Ps Line(s) (default = 1)
+	void onDL(unsigned short nb=1){}  // Delete Ps Line(s) (default = 1)
+	void onDCH(unsigned short nb=1){} // Delete Ps Character(s) (default = 1)
+	void onSU(unsigned short nb=1){}  // Scroll up Ps lines (default = 1)
+	void onSD(unsigned short nb=1){}  // Scroll down Ps lines (default = 1)
+	void onECH(unsigned short nb=1){}  // Erase Ps Character(s) (default = 1)
+	void onCBT(unsigned short nb=1){}  // Cursor Backward Tabulation Ps tab stops (default = 1)
+	void onHPA(TerminalParserParams nbs){}  // Character Position Absolute [column] (default = [row,1]) (HPA).
+	void onHPR(TerminalParserParams nbs){}  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
+	void onVPA(TerminalParserParams nbs){}  // Line Position Absolute [row] (default = [1,column])
+	void onVPR(TerminalParserParams nbs){}  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
+	void onHVP(unsigned short row=1, unsigned short col=1){} // Horizontal and Vertical Position [row;column] (default = [1,1])
+	void onTBC(unsigned short nb=0){}  // Tab Clear
+	void onSM(TerminalParserParams nbs){}  // Set Mode
+	void onDECSET(TerminalParserParams nbs){}  // DEC Private Mode Set
+	void onMC(TerminalParserParams nbs){}  // Media Copy
+	void onDECMC(TerminalParserParams nbs){}  // DEC specific Media Copy
+	void onRM(TerminalParserParams nbs){}  // Reset Mode
+	void onDECRST(TerminalParserParams nbs){}  // DEC Private Mode Reset
+	void onSGR(TerminalParserParams nbs){}  // Character Attributes
+	void onDSR(unsigned short nb){}  // Device Status Report
+	void onDECDSR(unsigned short nb){}  // DEC-specific Device Status Report
+	void onDECSTR(){}  // Soft terminal reset
+	void onDECSCL(unsigned short nb1, unsigned short nb2){} // Set conformance level
+	void onDECRQM(unsigned short nb){}  // Request DEC private mode
+	void onDECLL(unsigned short nb=0){}  // Load LEDs
+	void onDECSCUSR(unsigned short nb){}  // Set cursor style (DECSCUSR, VT520).
+	void onDECSCA(unsigned short nb=0){}  // Select character protection attribute (DECSCA).
+	void onDECSTBM(unsigned short top=0, unsigned short bottom=0){} // Set Scrolling Region [top;bottom] (default = full size of window)
+ 	void onRDECPMV(TerminalParserParams nbs){}  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
+	void onSDECPMV(TerminalParserParams nbs){}  // Save DEC Private Mode Values. P s values are the same as for DECSET.
+	void onDECCARA(TerminalParserParams nbs){}  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
+	void onDECSLRM(unsigned short left, unsigned short right){} // Set left and right margins (DECSLRM), available only when DECLRMM is enabled (VT420 and up).
+	void onANSISC(){}  // Save cursor (ANSI.SYS), available only when DECLRMM is disabled.
+	void onANSIRC(){}  // Restore cursor (ANSI.SYS).
+	void onWindowManip(unsigned short nb1, unsigned short nb2=0, unsigned short nb3=0){} // Set conformance level
+	void onDECRARA(TerminalParserParams nbs){}  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
+	void onDECSWBV(unsigned short nb){}  // Set warning-bell volume (DECSWBV, VT520).
+	void onDECSMBV(unsigned short nb){}  // Set margin-bell volume (DECSMBV, VT520).
+	void onDECCRA(TerminalParserParams nbs){}  // Copy Rectangular Area (DECCRA, VT400 and up).
+	void onDECEFR(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Enable Filter Rectangle (DECEFR), VT420 and up.
+	void onDECREQTPARM(unsigned short nb){}  // Request Terminal Parameters
+	void onDECSACE(unsigned short nb){}  // Select Attribute Change Extent
+	void onDECFRA(unsigned short chr, unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Fill Rectangular Area (DECFRA), VT420 and up.
+	void onDECRQCRA(unsigned short id, unsigned short page, unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Request Checksum of Rectangular Area (DECRQCRA), VT420 and up.
+	void onDECELR(unsigned short nb1, unsigned short nb2){} // Enable Locator Reporting (DECELR).
+	void onDECERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Erase Rectangular Area (DECERA), VT400 and up.
+	void onDECSLE(TerminalParserParams nbs){}  // Select Locator Events (DECSLE).
+	void onDECSERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Selective Erase Rectangular Area (), VT400 and up.
+ 	void onDECRQLP(unsigned short nb){}  // Request Locator Position (DECRQLP).
+	void onDECIC(unsigned short nb=1){}  // Insert P s Column(s) (default = 1) (DECIC), VT420 and up.
+	void onDECDC(unsigned short nb=1){}  // InsDelete P s Column(s) (default = 1) (DECIC), VT420 and up.
+	/** \} */
+
+	
+	/** OSC Control handlers
+	 * OSC strings are delivered in chunks, as they are received: onOSCBegin(), onOSCData()... then onOSCEnd().
+	 * Default implementation buffers the string (up to the payload limit) and calls onOSC(command, params) at end.
+	 * \{ */
+	/**
+	 * Receive the start of an OSC (Operating System Command) string.
+	 * \param command Command (First decoded integer).
+	 */
+	void onOSCBegin(unsigned short command);
+	/**
+	 * Receive a chunk of the current OSC string.
+	 */
+	void onOSCData(TerminalParserPayload data);
+	/**
+	 * Receive the end of the current OSC string.
+	 * \param truncated True if the string was longer than the payload limit and has been truncated.
+	 */
+	void onOSCEnd(bool truncated);
+	/**
+	 * Receive an OSC (Operating System Command) command.
+	 * \param command Command (First decoded integer).
+	 * \param params Optionnal parameter sequence.
+     */
+	void onOSC(unsigned short command, const std::vector<unsigned char>& params);
+	/** \} */
+
+	/** DCS Control handlers
+	 * DCS strings are delivered in chunks, as they are received: onDCSBegin(), onDCSData()... then onDCSEnd().
+	 * \{ */
+	/**
+	 * Receive the start of a DCS (Device Control String).
+	 * \param command Final character of the DCS header.
+	 * \param params Parameters of the DCS header.
+	 * \param collect Private marker and intermediate chars of the DCS header.
+	 */
+	void onDCSBegin(unsigned char command, TerminalParserParams params, TerminalParserIntermediates collect){}
+	/**
+	 * Receive a chunk of the current DCS string.
+	 */
+	void onDCSData(TerminalParserPayload data){}
+	/**
+	 * Receive the end of the current DCS string.
+	 * \param truncated True if the string was longer than the payload limit and has been truncated.
+	 */
+	void onDCSEnd(bool truncated){}
+	/** \} */
+
+private:
+	Derived& derived(){return *static_cast<Derived*>(this);}
+
+	/**
+	 * Change to a new state
+	 * \param c Char triggering the transition, if any, passed to entry and exit actions.
+	 */
+	void Transition(WXTP_STATE state, unsigned char c = 0);
+
+	/**
+	 * Decode and deliver a run of printable chars.
+	 */
+	void Print(const unsigned char* run, size_t len);
+
+	/**
+	 * Deliver a replacement character for an incomplete UTF-8 sequence, if any.
+	 */
+	void FlushText();
+
+	/**
+	 * Deliver a chunk of OSC or DCS payload, depending on the current state.
+	 */
+	void Payload(const unsigned char* data, size_t len);
+
+	/**
+	 * Process one char through the transition table.
+	 */
+	void Step(unsigned char c);
+
+	/**
+	 * Do a state machine action.
+	 */
+	void Do(WXTP_ACTION action, unsigned char c);
+};
+
+
+/**
+ * Terminal parser with virtual handlers.
+ * Thin adapter over TerminalParserT, for parser users which prefer overriding to static dispatch.
+ * \see TerminalParserT for handler documentation.
+ */
+class TerminalParser : public TerminalParserT<TerminalParser>
+{
+	friend class TerminalParserT<TerminalParser>;
+	typedef TerminalParserT<TerminalParser> ParserBase;
+protected:
+	TerminalParser(){}
+	virtual ~TerminalParser(){}
+
+	virtual void onPrintableText(TerminalParserText text){}
+
+	virtual void onSP(){}
+	virtual void onDEL(){}	
+
+	virtual void onESC(unsigned char command){ParserBase::onESC(command);}
+	virtual void onESC(unsigned char command, unsigned char param){ParserBase::onESC(command, param);}	
 	virtual void onS7C1T(){} // 7-bit controls
 	virtual void onS8C1T(){} // 8-bit controls
 	virtual void onANSIconf1(){} // Set ANSI conformance level 1  (vt100, 7-bit controls).
@@ -83,16 +772,7 @@ protected:
 	virtual void onLS1R(){} // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
 	virtual void onLS2R(){} // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
 	virtual void onLS3R(){} // Invoke the G1 Character Set as GR (). Has no visible effect in xterm.
-	/** \} */
-
-	
-	/** C0 Control code handlers
-	 * \{ */
-	/**
-	 * Execute C0 control code (0x00-0x1F)
-	 * http://en.wikipedia.org/wiki/C0_and_C1_control_codes
-	 */
-	virtual void executeC0ControlCode(unsigned char c);
+	virtual void executeC0ControlCode(unsigned char c){ParserBase::executeC0ControlCode(c);}
 	virtual void onNUL(){}  // 0x00
 	virtual void onSOH(){}  // 0x01
 	virtual void onSTX(){}  // 0x02
@@ -117,24 +797,15 @@ protected:
 	virtual void onNAK(){}  // 0x15
 	virtual void onSYN(){}  // 0x16
 	virtual void onETB(){}  // 0x17
-	virtual void onCAN();   // 0x18
+	virtual void onCAN(){ParserBase::onCAN();}   // 0x18
 	virtual void onEM(){}   // 0x19
-	virtual void onSUB();   // 0x1A
-	virtual void onESC();   // 0x1B
+	virtual void onSUB(){ParserBase::onSUB();}   // 0x1A
+	virtual void onESC(){ParserBase::onESC();}   // 0x1B
 	virtual void onFS(){}   // 0x1C
 	virtual void onGS(){}   // 0x1D
 	virtual void onRS(){}   // 0x1E
 	virtual void onUS(){}   // 0x1F
-	/** \} */
-
-	
-	/** C1 Control code handlers
-	 * \{ */
-	/**
-	 * Execute C1 control code (0x80-0x9F)
-	 * http://en.wikipedia.org/wiki/C0_and_C1_control_codes
-	 */
-	virtual void executeC1ControlCode(unsigned char c);
+	virtual void executeC1ControlCode(unsigned char c){ParserBase::executeC1ControlCode(c);}
 	virtual void onPAD(){}  // 0x80
 	virtual void onHOP(){}  // 0x81
 	virtual void onBPH(){}  // 0x82
@@ -151,7 +822,7 @@ protected:
 	virtual void onRI(){}   // 0x8D
 	virtual void onSS2(){}  // 0x8E
 	virtual void onSS3(){}  // 0x8F
-	virtual void onDCS();   // 0x90
+	virtual void onDCS(){ParserBase::onDCS();}   // 0x90
 	virtual void onPU1(){}  // 0x91
 	virtual void onPU2(){}  // 0x92
 	virtual void onSTS(){}  // 0x93
@@ -159,25 +830,15 @@ protected:
 	virtual void onMW(){}   // 0x95
 	virtual void onSPA(){}  // 0x96
 	virtual void onEPA(){}  // 0x97
-	virtual void onSOS();   // 0x98
+	virtual void onSOS(){ParserBase::onSOS();}   // 0x98
 	virtual void onSGCI(){} // 0x99
 	virtual void onSCI(){}  // 0x9A
-	virtual void onCSI();   // 0x9B
-	virtual void onST();    // 0x9C
-	virtual void onOSC();   // 0x9D
-	virtual void onPM();    // 0x9E
-	virtual void onAPC();   // 0x9F
-	/** \} */
-	
-
-	/** CSI Control handlers
-	 * \{ */
-	/**
-	 * Receive a CSI (Control Sequence Introducer) command.
-	 * \param command Command character (last character of CSI sequence).
-	 * \param params  Optionnal parameter sequence.
-     */
-	virtual void onCSI(unsigned char command, const std::vector<unsigned short>& params, const std::vector<unsigned char>& collect);
+	virtual void onCSI(){ParserBase::onCSI();}   // 0x9B
+	virtual void onST(){ParserBase::onST();}    // 0x9C
+	virtual void onOSC(){ParserBase::onOSC();}   // 0x9D
+	virtual void onPM(){ParserBase::onPM();}    // 0x9E
+	virtual void onAPC(){ParserBase::onAPC();}   // 0x9F
+	virtual void onCSI(unsigned char command, TerminalParserParams params, TerminalParserIntermediates collect){ParserBase::onCSI(command, params, collect);}
 	virtual void onICH(unsigned short nb=1){} // Insert P s (Blank) Character(s) (default = 1)
 	virtual void onCUU(unsigned short nb=1){} // Cursor Up P s Times (default = 1)
 	virtual void onCUD(unsigned short nb=1){} // Cursor Down P s Times (default = 1)
@@ -199,19 +860,19 @@ protected:
 	virtual void onSD(unsigned short nb=1){}  // Scroll down Ps lines (default = 1)
 	virtual void onECH(unsigned short nb=1){}  // Erase Ps Character(s) (default = 1)
 	virtual void onCBT(unsigned short nb=1){}  // Cursor Backward Tabulation Ps tab stops (default = 1)
-	virtual void onHPA(const std::vector<unsigned short> nbs){}  // Character Position Absolute [column] (default = [row,1]) (HPA).
-	virtual void onHPR(const std::vector<unsigned short> nbs){}  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
-	virtual void onVPA(const std::vector<unsigned short> nbs){}  // Line Position Absolute [row] (default = [1,column])
-	virtual void onVPR(const std::vector<unsigned short> nbs){}  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
+	virtual void onHPA(TerminalParserParams nbs){}  // Character Position Absolute [column] (default = [row,1]) (HPA).
+	virtual void onHPR(TerminalParserParams nbs){}  // Character Position Relative [columns] (default = [row,col+1]) (HPR).
+	virtual void onVPA(TerminalParserParams nbs){}  // Line Position Absolute [row] (default = [1,column])
+	virtual void onVPR(TerminalParserParams nbs){}  // Line Position Relative [rows] (default = [row+1,column]) (VPR)
 	virtual void onHVP(unsigned short row=1, unsigned short col=1){} // Horizontal and Vertical Position [row;column] (default = [1,1])
 	virtual void onTBC(unsigned short nb=0){}  // Tab Clear
-	virtual void onSM(const std::vector<unsigned short> nbs){}  // Set Mode
-	virtual void onDECSET(const std::vector<unsigned short> nbs){}  // DEC Private Mode Set
-	virtual void onMC(const std::vector<unsigned short> nbs){}  // Media Copy
-	virtual void onDECMC(const std::vector<unsigned short> nbs){}  // DEC specific Media Copy
-	virtual void onRM(const std::vector<unsigned short> nbs){}  // Reset Mode
-	virtual void onDECRST(const std::vector<unsigned short> nbs){}  // DEC Private Mode Reset
-	virtual void onSGR(const std::vector<unsigned short> nbs){}  // Character Attributes
+	virtual void onSM(TerminalParserParams nbs){}  // Set Mode
+	virtual void onDECSET(TerminalParserParams nbs){}  // DEC Private Mode Set
+	virtual void onMC(TerminalParserParams nbs){}  // Media Copy
+	virtual void onDECMC(TerminalParserParams nbs){}  // DEC specific Media Copy
+	virtual void onRM(TerminalParserParams nbs){}  // Reset Mode
+	virtual void onDECRST(TerminalParserParams nbs){}  // DEC Private Mode Reset
+	virtual void onSGR(TerminalParserParams nbs){}  // Character Attributes
 	virtual void onDSR(unsigned short nb){}  // Device Status Report
 	virtual void onDECDSR(unsigned short nb){}  // DEC-specific Device Status Report
 	virtual void onDECSTR(){}  // Soft terminal reset
@@ -221,17 +882,17 @@ protected:
 	virtual void onDECSCUSR(unsigned short nb){}  // Set cursor style (DECSCUSR, VT520).
 	virtual void onDECSCA(unsigned short nb=0){}  // Select character protection attribute (DECSCA).
 	virtual void onDECSTBM(unsigned short top=0, unsigned short bottom=0){} // Set Scrolling Region [top;bottom] (default = full size of window)
- 	virtual void onRDECPMV(const std::vector<unsigned short> nbs){}  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
-	virtual void onSDECPMV(const std::vector<unsigned short> nbs){}  // Save DEC Private Mode Values. P s values are the same as for DECSET.
-	virtual void onDECCARA(const std::vector<unsigned short> nbs){}  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
+ 	virtual void onRDECPMV(TerminalParserParams nbs){}  // Restore DEC Private Mode Values. The value of P s previously saved is restored. P s values are the same as for DECSET.
+	virtual void onSDECPMV(TerminalParserParams nbs){}  // Save DEC Private Mode Values. P s values are the same as for DECSET.
+	virtual void onDECCARA(TerminalParserParams nbs){}  // Change Attributes in Rectangular Area (DECCARA), VT400 and up.
 	virtual void onDECSLRM(unsigned short left, unsigned short right){} // Set left and right margins (DECSLRM), available only when DECLRMM is enabled (VT420 and up).
 	virtual void onANSISC(){}  // Save cursor (ANSI.SYS), available only when DECLRMM is disabled.
 	virtual void onANSIRC(){}  // Restore cursor (ANSI.SYS).
 	virtual void onWindowManip(unsigned short nb1, unsigned short nb2=0, unsigned short nb3=0){} // Set conformance level
-	virtual void onDECRARA(const std::vector<unsigned short> nbs){}  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
+	virtual void onDECRARA(TerminalParserParams nbs){}  // Reverse Attributes in Rectangular Area (DECRARA), VT400 and up.
 	virtual void onDECSWBV(unsigned short nb){}  // Set warning-bell volume (DECSWBV, VT520).
 	virtual void onDECSMBV(unsigned short nb){}  // Set margin-bell volume (DECSMBV, VT520).
-	virtual void onDECCRA(const std::vector<unsigned short> nbs){}  // Copy Rectangular Area (DECCRA, VT400 and up).
+	virtual void onDECCRA(TerminalParserParams nbs){}  // Copy Rectangular Area (DECCRA, VT400 and up).
 	virtual void onDECEFR(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Enable Filter Rectangle (DECEFR), VT420 and up.
 	virtual void onDECREQTPARM(unsigned short nb){}  // Request Terminal Parameters
 	virtual void onDECSACE(unsigned short nb){}  // Select Attribute Change Extent
@@ -239,91 +900,745 @@ protected:
 	virtual void onDECRQCRA(unsigned short id, unsigned short page, unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Request Checksum of Rectangular Area (DECRQCRA), VT420 and up.
 	virtual void onDECELR(unsigned short nb1, unsigned short nb2){} // Enable Locator Reporting (DECELR).
 	virtual void onDECERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Erase Rectangular Area (DECERA), VT400 and up.
-	virtual void onDECSLE(const std::vector<unsigned short> nbs){}  // Select Locator Events (DECSLE).
+	virtual void onDECSLE(TerminalParserParams nbs){}  // Select Locator Events (DECSLE).
 	virtual void onDECSERA(unsigned short top, unsigned short left, unsigned short bottom, unsigned short right){} // Selective Erase Rectangular Area (), VT400 and up.
  	virtual void onDECRQLP(unsigned short nb){}  // Request Locator Position (DECRQLP).
 	virtual void onDECIC(unsigned short nb=1){}  // Insert P s Column(s) (default = 1) (DECIC), VT420 and up.
 	virtual void onDECDC(unsigned short nb=1){}  // InsDelete P s Column(s) (default = 1) (DECIC), VT420 and up.
-	/** \} */
+	virtual void onOSCBegin(unsigned short command){ParserBase::onOSCBegin(command);}
+	virtual void onOSCData(TerminalParserPayload data){ParserBase::onOSCData(data);}
+	virtual void onOSCEnd(bool truncated){ParserBase::onOSCEnd(truncated);}
+	virtual void onOSC(unsigned short command, const std::vector<unsigned char>& params){ParserBase::onOSC(command, params);}
+	virtual void onDCSBegin(unsigned char command, TerminalParserParams params, TerminalParserIntermediates collect){}
+	virtual void onDCSData(TerminalParserPayload data){}
+	virtual void onDCSEnd(bool truncated){}
+};
 
-	
-	/** OSC Control handlers
-	 * \{ */
-	/**
-	 * Receive an OSC (Operating System Command) command.
-	 * \param command Command (First decoded integer).
-	 * \param params Optionnal parameter sequence.
-     */
-	virtual void onOSC(unsigned short command, const std::vector<unsigned char>& params);
-	/** \} */
 
-private:
-	enum WXTP_STATE
+//
+// TerminalParserT implementation.
+//
+
+template<class Derived>
+void TerminalParserT<Derived>::Process(unsigned char c)
+{
+	Process(&c, 1);
+}
+
+template<class Derived>
+inline void TerminalParserT<Derived>::Step(unsigned char c)
+{
+	unsigned char entry = m_table->transitions[m_state][c];
+
+	// Param is by far the most frequent action inside sequences, shortcut it.
+	WXTP_ACTION action = (WXTP_ACTION)(entry >> 4);
+	if(action == WXTP_ACTION_PARAM)
+		Param(c);
+	else if(action != WXTP_ACTION_NONE)
+		Do(action, c);
+
+	if((entry & 0x0F) != Table::NO_TRANSITION)
+		Transition((WXTP_STATE)(entry & 0x0F), c);
+}
+
+template<class Derived>
+inline void TerminalParserT<Derived>::Do(WXTP_ACTION action, unsigned char c)
+{
+	switch(action)
 	{
-		WXTP_STATE_GROUND,
-		WXTP_STATE_ESCAPE,
-		WXTP_STATE_ESCAPE_INTERMEDIATE,
-		WXTP_STATE_CSI_ENTRY,
-		WXTP_STATE_CSI_PARAM,
-		WXTP_STATE_CSI_INTERMEDIATE,
-		WXTP_STATE_CSI_IGNORE,
-		WXTP_STATE_DCS_ENTRY,
-		WXTP_STATE_DCS_PARAM,
-		WXTP_STATE_DCS_INTERMEDIATE,
-		WXTP_STATE_DCS_PASSTHROUGH,
-		WXTP_STATE_DCS_IGNORE,
-		WXTP_STATE_OSC_ENTRY,
-		WXTP_STATE_OSC_STRING,
-		WXTP_STATE_SOS_PM_APC_STRING
-	}m_state;
+		case WXTP_ACTION_NONE:
+			break;
+		case WXTP_ACTION_EXECUTE:
+			// Transition is done in default handler when needed.
+			derived().executeC0ControlCode(c);
+			break;
+		case WXTP_ACTION_EXECUTE_C1:
+			// Transition is done in default handler when needed.
+			derived().executeC1ControlCode(c);
+			break;
+		case WXTP_ACTION_PRINT:
+			Print(&c, 1);
+			break;
+		case WXTP_ACTION_ESC_COLLECT:
+			// Special char collect
+			m_escapedFirstChar = c;
+			break;
+		case WXTP_ACTION_COLLECT:
+			Collect(c);
+			break;
+		case WXTP_ACTION_PARAM:
+			Param(c);
+			break;
+		case WXTP_ACTION_ESC_DISPATCH:
+			// Direct call to onESC(cmd)
+			derived().onESC(c);
+			break;
+		case WXTP_ACTION_ESC2_DISPATCH:
+			// Direct call to onESC(cmd, param)
+			derived().onESC(m_escapedFirstChar, c);
+			break;
+		case WXTP_ACTION_CSI_DISPATCH:
+			// Direct call to onCSI(cmd, params, m_collected)
+			derived().onCSI(c, TerminalParserParams(m_params.data(), m_params.size(), m_subParams), m_collected);
+			break;
+		case WXTP_ACTION_PUT:
+			Payload(&c, 1);
+			break;
+		case WXTP_ACTION_CLEAR:
+			Clear();
+			break;
+		case WXTP_ACTION_HOOK:
+			// Hooked by the DCS final char.
+			PayloadStart();
+			derived().onDCSBegin(c, TerminalParserParams(m_params.data(), m_params.size(), m_subParams), m_collected);
+			break;
+		case WXTP_ACTION_UNHOOK:
+			derived().onDCSEnd(m_payloadTruncated);
+			break;
+		case WXTP_ACTION_OSC_PUT:
+			// The first string char ends the command number.
+			if(m_state == WXTP_STATE_OSC_ENTRY)
+				Transition(WXTP_STATE_OSC_STRING);
+			Payload(&c, 1);
+			break;
+		case WXTP_ACTION_OSC_START:
+			// OSC without command number are ignored.
+			m_oscActive = !m_params.empty();
+			PayloadStart();
+			if(m_oscActive)
+				derived().onOSCBegin(m_params[0]);
+			break;
+		case WXTP_ACTION_OSC_END:
+			if(m_oscActive)
+				derived().onOSCEnd(m_payloadTruncated);
+			break;
+		default:
+			/* Must not occurs ! */
+			break;
+	}
+}
 
-	/**
-	 * Change to a new state
-	 */
-	void Transition(WXTP_STATE state);
+template<class Derived>
+void TerminalParserT<Derived>::Process(const unsigned char* buff, size_t sz)
+{
+	const unsigned char* end = buff + sz;
+	while(buff < end)
+	{
+		if(m_state == WXTP_STATE_GROUND)
+		{
+			// Fast path: the state machine only runs on control chars,
+			// everything up to the next one is printed at once.
+			const unsigned char* run = buff;
+			buff = FindGroundControl(buff, end, m_groundControlMask);
+			if(buff > run)
+			{
+				Print(run, buff - run);
+				continue;
+			}
 
-	/**
-	 * Clear
-	 */
-	void Clear();
+			// A control char interrupts an incomplete UTF-8 sequence.
+			if(m_utf8Decoder.pending())
+				FlushText();
+		}
+		else if(m_state == WXTP_STATE_OSC_STRING || m_state == WXTP_STATE_DCS_PASSTHROUGH)
+		{
+			// Same for OSC and DCS strings, the payload is delivered by chunks.
+			const unsigned char* run = buff;
+			buff = FindGroundControl(buff, end, m_groundControlMask);
+			if(buff > run)
+			{
+				Payload(run, buff - run);
+				continue;
+			}
+		}
 
-	/**
-	 * Collect the current character.
-	 */
-	void Collect(unsigned char c);
+		// Control codes and non-ground states are processed char by char.
+		Step(*buff++);
+	}
+}
 
-	/**
-	 * PARAM
-	 */
-	void Param(unsigned char c);
-	
+template<class Derived>
+void TerminalParserT<Derived>::Print(const unsigned char* run, size_t len)
+{
+	// Decode by blocks, each byte gives at most one code point,
+	// plus one for a sequence left incomplete by the previous block.
+	char32_t text[256+1];
+	while(len > 0)
+	{
+		size_t sz = len < 256 ? len : 256;
+		size_t count = Decode(run, sz, text);
+		if(count > 0)
+			derived().onPrintableText(TerminalParserText(text, count));
+		run += sz;
+		len -= sz;
+	}
+}
 
-	/**
-	 * DCS relative functions.
-	 * \{
-	 */
-	
-	/** Hook */
-	void DcsHook();
+template<class Derived>
+void TerminalParserT<Derived>::Transition(WXTP_STATE state, unsigned char c)
+{
+	// Exit old state
+	if(m_table->exitActions[m_state] != WXTP_ACTION_NONE)
+		Do((WXTP_ACTION)m_table->exitActions[m_state], c);
+
+	m_state = state;
+
+	// Enter new state
+	if(m_table->entryActions[m_state] != WXTP_ACTION_NONE)
+		Do((WXTP_ACTION)m_table->entryActions[m_state], c);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::FlushText()
+{
+	char32_t replacement = TerminalUTF8Decoder::REPLACEMENT_CHARACTER;
+	m_utf8Decoder.reset();
+	derived().onPrintableText(TerminalParserText(&replacement, 1));
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::Payload(const unsigned char* data, size_t len)
+{
+	len = PayloadRoom(len);
+	if(len == 0)
+		return;
+	if(m_state == WXTP_STATE_DCS_PASSTHROUGH)
+		derived().onDCSData(TerminalParserPayload(data, len));
+	else if(m_oscActive)
+		derived().onOSCData(TerminalParserPayload(data, len));
+}
+
+
+template<class Derived>
+void TerminalParserT<Derived>::executeC0ControlCode(unsigned char c)
+{
+	switch(c)
+	{
+		case 0x00: derived().onNUL();	break;
+		case 0x01: derived().onSOH();	break;
+		case 0x02: derived().onSTX(); break;
+		case 0x03: derived().onETX(); break;
+		case 0x04: derived().onEOT(); break;
+		case 0x05: derived().onENQ(); break;
+		case 0x06: derived().onACK(); break;
+		case 0x07: derived().onBEL(); break;
+		case 0x08: derived().onBS(); break;
+		case 0x09: derived().onHT(); break;
+		case 0x0A: derived().onLF(); break;
+		case 0x0B: derived().onVT(); break;
+		case 0x0C: derived().onFF(); break;
+		case 0x0D: derived().onCR(); break;
+		case 0x0E: derived().onSO(); break;
+		case 0x0F: derived().onSI(); break;
+		case 0x10: derived().onDLE(); break;
+		case 0x11: derived().onDC1(); break;
+		case 0x12: derived().onDC2(); break;
+		case 0x13: derived().onDC3(); break;
+		case 0x14: derived().onDC4(); break;
+		case 0x15: derived().onNAK(); break;
+		case 0x16: derived().onSYN(); break;
+		case 0x17: derived().onETB(); break;
+		case 0x18: derived().onCAN(); break;
+		case 0x19: derived().onEM(); break;
+		case 0x1A: derived().onSUB(); break;
+		case 0x1B: derived().onESC(); break;
+		case 0x1C: derived().onFS(); break;
+		case 0x1D: derived().onGS(); break;
+		case 0x1E: derived().onRS(); break;
+		case 0x1F: derived().onUS(); break;
+		default:
+			// Must not occur (out of range)
+			break;
+	}
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onCAN()
+{
+	Transition(WXTP_STATE_GROUND);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onSUB()
+{
+	Transition(WXTP_STATE_GROUND);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onESC()
+{
+	Transition(WXTP_STATE_ESCAPE);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::executeC1ControlCode(unsigned char c)
+{
+	switch(c)
+	{
+		case 0x80: derived().onPAD(); break;
+		case 0x81: derived().onHOP(); break;
+		case 0x82: derived().onBPH(); break;
+		case 0x83: derived().onNBH(); break;
+		case 0x84: derived().onIND(); break;
+		case 0x85: derived().onNEL(); break;
+		case 0x86: derived().onSSA(); break;
+		case 0x87: derived().onESA(); break;
+		case 0x88: derived().onHTS(); break;
+		case 0x89: derived().onHTJ(); break;
+		case 0x8A: derived().onVTS(); break;
+		case 0x8B: derived().onPLD(); break;
+		case 0x8C: derived().onPLU(); break;
+		case 0x8D: derived().onRI(); break;
+		case 0x8E: derived().onSS2(); break;
+		case 0x8F: derived().onSS3(); break;
+		case 0x90: derived().onDCS(); break;
+		case 0x91: derived().onPU1(); break;
+		case 0x92: derived().onPU2(); break;
+		case 0x93: derived().onSTS(); break;
+		case 0x94: derived().onCCH(); break;
+		case 0x95: derived().onMW(); break;
+		case 0x96: derived().onSPA(); break;
+		case 0x97: derived().onEPA(); break;
+		case 0x98: derived().onSOS(); break;
+		case 0x99: derived().onSGCI(); break;
+		case 0x9A: derived().onSCI(); break;
+		case 0x9B: derived().onCSI(); break;
+		case 0x9C: derived().onST(); break;
+		case 0x9D: derived().onOSC(); break;
+		case 0x9E: derived().onPM(); break;
+		case 0x9F: derived().onAPC(); break;
+		default:
+			// Must not occur (out of range)
+			break;		
+	}
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onDCS()
+{
+	Transition(WXTP_STATE_DCS_ENTRY);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onSOS()
+{
+	Transition(WXTP_STATE_SOS_PM_APC_STRING);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onCSI()
+{
+	Transition(WXTP_STATE_CSI_ENTRY);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onST()
+{
+	Transition(WXTP_STATE_GROUND);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onOSC()
+{
+	Transition(WXTP_STATE_OSC_ENTRY);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onPM()
+{
+	Transition(WXTP_STATE_SOS_PM_APC_STRING);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onAPC()
+{
+	Transition(WXTP_STATE_SOS_PM_APC_STRING);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onOSCBegin(unsigned short command)
+{
+	m_oscCommand = command;
+	m_oscString.clear();
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onOSCData(TerminalParserPayload data)
+{
+	m_oscString.insert(m_oscString.end(), data.begin(), data.end());
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onOSCEnd(bool truncated)
+{
+	derived().onOSC(m_oscCommand, m_oscString);
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onOSC(unsigned short command, const std::vector<unsigned char>& params)
+{
 	
-	/** Unhook */
-	void DcsUnhook();
+}
 
-	/** PUT */
-	void DcsPut(unsigned char c);
+template<class Derived>
+void TerminalParserT<Derived>::onCSI(unsigned char command, TerminalParserParams params, TerminalParserIntermediates collect)
+{
+	// Sub-parameters are only defined for SGR, other sequences using them are ignored.
+	if(params.hasSubs() && command!='m')
+		return;
 
-	/** \} *
+	// TODO Add vector size test for each command and error handling if not.
+	switch(command)
+	{
+		case '@': derived().onICH(params.empty()?1:params[0]); break;
+		case 'A': derived().onCUU(params.empty()?1:params[0]); break;
+		case 'B': derived().onCUD(params.empty()?1:params[0]); break;
+		case 'C': derived().onCUF(params.empty()?1:params[0]); break;
+		case 'D': derived().onCUB(params.empty()?1:params[0]); break;
+		case 'E': derived().onCNL(params.empty()?1:params[0]); break;
+		case 'F': derived().onCPL(params.empty()?1:params[0]); break;
+		case 'G': derived().onCHA(params.empty()?1:params[0]); break;
+		case 'H': derived().onCUP(params.size()<1?1:params[0], params.size()<2?1:params[1]); break;
+		case 'I': derived().onCHT(params.empty()?1:params[0]); break;
+		case 'J':
+			if(collect.size()>0 && collect[0]=='?')
+				derived().onDECSED(params.empty()?0:params[0]);
+			else
+				derived().onED(params.empty()?0:params[0]);
+			break;
+		case 'K':
+			if(collect.size()>0 && collect[0]=='?')
+				derived().onDECSEL(params.empty()?0:params[0]);
+			else
+				derived().onEL(params.empty()?0:params[0]);
+			break;
+		case 'L': derived().onIL(params.empty()?1:params[0]); break;
+		case 'M': derived().onDL(params.empty()?1:params[0]); break;
+		case 'P': derived().onDCH(params.empty()?1:params[0]); break;
+		case 'S': derived().onSU(params.empty()?1:params[0]); break;
+		case 'T': derived().onSD(params.empty()?1:params[0]); break;
+		case 'X': derived().onECH(params.empty()?1:params[0]); break;
+		case 'Z': derived().onCBT(params.empty()?1:params[0]); break;
+		case '`': derived().onHPA(params); break;
+		case 'a': derived().onHPR(params); break;
+		case 'd': derived().onVPA(params); break;
+		case 'e': derived().onVPR(params); break;
+		case 'f': derived().onHVP(params.size()<1?1:params[0], params.size()<2?1:params[1]); break;
+		case 'g': derived().onTBC(params.empty()?0:params[0]); break;
+		case 'h':
+			if(collect.size()>0 && collect[0]=='?')
+				derived().onDECSET(params);
+			else
+				derived().onSM(params);
+			break;
+		case 'i':
+			if(collect.size()>0 && collect[0]=='?')
+				derived().onDECMC(params);
+			else
+				derived().onMC(params);
+			break;
+		case 'l':
+			if(collect.size()>0 && collect[0]=='?')
+				derived().onDECRST(params);
+			else
+				derived().onRM(params);
+			break;
+		case 'm': derived().onSGR(params); break;
+		case 'n':
+			if(collect.size()>0 && collect[0]=='?')
+				derived().onDECDSR(params[0]);
+			else
+				derived().onDSR(params[0]);
+			break;
+		case 'p':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='!')
+					derived().onDECSTR();
+				else if(collect[0]=='"')
+					derived().onDECSCL(params[0], params[1]);
+			}
+			else if(collect.size()==2)
+			{
+				if(collect[0]=='?' && collect[0]=='$')
+					derived().onDECRQM(params[0]);
+			}
+			break;
+		case 'q':
+			if(collect.size()==0)
+				derived().onDECLL(params[0]);
+			else if(collect.size()==1)
+			{
+				if(collect[0]==' ')
+					derived().onDECSCUSR(params[0]);
+				else if(collect[0]=='"')
+					derived().onDECSCA(params[0]);
+			}
+			break;
+		case 'r':
+			if(collect.size()==0)
+				derived().onDECSTBM(params[0], params[1]);
+			else if(collect.size()==1)
+			{
+				if(collect[0]=='?')
+					derived().onRDECPMV(params);
+				else if(collect[0]=='$')
+					derived().onDECCARA(params);
+			}
+			break;
+		case 's':
+			if(collect.size()==0)
+			{
+				if(params.size()==0)
+					derived().onANSISC();
+				else if(params.size()>=2)
+					derived().onDECSLRM(params[0], params[1]);
+			}
+			else if(collect[0]=='?')
+			{
+				derived().onSDECPMV(params);
+			}
+			break;
+		case 't':
+			if(collect.size()==0)
+			{
+				if(params.size()==1)
+					derived().onWindowManip(params[0]);
+				else if(params.size()==2)
+					derived().onWindowManip(params[0], params[1]);
+				else if(params.size()==3)
+					derived().onWindowManip(params[0], params[1], params[2]);
+			}
+			else if(collect.size()==1)
+			{
+				if(collect[0]==' ')
+					derived().onDECSWBV(params[0]);
+				else if(collect[0]=='$')
+					derived().onDECRARA(params);
+			}
+			break;
+		case 'u':
+			if(collect.size()==0)
+			{
+				derived().onANSIRC();
+			}
+			else if(collect[0]==' ')
+			{
+				derived().onDECSMBV(params[0]);
+			}
+			break;
+		case 'v':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='$')
+				{
+					derived().onDECCRA(params);
+				}
+			}			 
+			break;
+		case 'w':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='`')
+				{
+					derived().onDECEFR(params[0], params[1], params[2], params[3]);
+				}
+			}
+			break;
+		case 'x':
+			if(collect.size()==0)
+			{
+				derived().onDECREQTPARM(params[0]);
+			}
+			else if(collect[0]=='*')
+			{
+				derived().onDECSACE(params[0]);
+			}
+			else if(collect[0]=='$')
+			{
+				derived().onDECFRA(params[0], params[1], params[2], params[3], params[4]);
+			}
+			break;
+		case 'y':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='*')
+				{
+					derived().onDECRQCRA(params[0], params[1], params[2], params[3], params[5], params[6]);
+				}
+			}
+			break;
+		case 'z':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='`')
+				{
+					derived().onDECELR(params[0], params[1]);
+				}
+				else if(collect[0]=='$')
+				{
+					derived().onDECERA(params[0], params[1], params[2], params[3]);
+				}
+			}
+			break;
+		case '{':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='`')
+				{
+					derived().onDECSLE(params);
+				}
+				else if(collect[0]=='$')
+				{
+					derived().onDECSERA(params[0], params[1], params[2], params[3]);
+				}
+			}
+			break;
+		case '|':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='`')
+				{
+					derived().onDECRQLP(params[0]);
+				}
+			}
+			break;
+		case '}':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='\'')
+				{
+					derived().onDECIC(params[0]);
+				}
+			}
+			break;			
+		case '~':
+			if(collect.size()==1)
+			{
+				if(collect[0]=='\'')
+				{
+					derived().onDECDC(params[0]);
+				}
+			}
+			break;
+		default:
+			/* TODO CSI interpreting is not fully implemented yet. */
+			std::cout << "CSI " << (char)command << std::endl; 
+			break;
+	}	
+}
+
+template<class Derived>
+void TerminalParserT<Derived>::onESC(unsigned char command)
+{
+	switch(command)
+	{
+		// Traditionnal commands:
+		case 'D': derived().onIND(); break;
+		case 'E': derived().onNEL(); break;
+		case 'H': derived().onHTS(); break;
+		case 'M': derived().onRI(); break;
+		case 'N': derived().onSS2(); break;
+		case 'O': derived().onSS3(); break;
+		case 'P': derived().onDCS(); break;
+		case 'V': derived().onSPA(); break;
+		case 'W': derived().onEPA(); break;
+		case 'X': derived().onSOS(); break;
+		case 'Z': derived().onSCI(); break; // TODO Validate that!!
+		case '\\': derived().onST(); break;
+		case '^': derived().onPM(); break;
+		case '_': derived().onAPC(); break;
 		
-	/** Vector for storing collected data. \see Collect(unsigned char) */
-	std::vector<unsigned char> m_collected;
+		// Advanced commands:
+		case '6': derived().onDECBI(); break;
+		case '7': derived().onDECSC(); break;
+		case '8': derived().onDECRC(); break;
+		case '9': derived().onDECFI(); break;
+		case '=': derived().onDECKPAM(); break;
+		case '>': derived().onDECKPNM(); break;
+		case 'c': derived().onRIS(); break;
+		case 'n': derived().onLS2(); break;
+		case 'o': derived().onLS3(); break;
+		case '|': derived().onLS3R(); break;
+		case '}': derived().onLS2R(); break;
+		case '~': derived().onLS1R(); break;
 
-	/** Vector for storing collected parameters. \see Param(unsigned char) */
-	std::vector<unsigned short> m_params;
+		// Following commands should be processed elsewhere:			
+		case '[': // CSI (Control Sequence Introducer) : Should not pass here !
+		case ']': // OSC (Operating System Command) : Should not pass here !
+			break;
+		
+		// HP Extensions:
+		case 'F':
+		case 'l':
+		case 'm':
+			// TODO Should I support HP extensions ???
+			break;
+			
+		default:
+			break;
+	}
+}
 
-	/** First escaping character, if any. */
-	unsigned char m_escapedFirstChar;
-};
+template<class Derived>
+void TerminalParserT<Derived>::onESC(unsigned char command, unsigned char param)
+{
+	switch(command)
+	{
+	case ' ': // Conformance and control character set
+		switch(param)
+		{
+			case 'F': Set8BitControls(false); derived().onS7C1T(); break;
+			case 'G': Set8BitControls(true); derived().onS8C1T(); break;
+			case 'L': derived().onANSIconf1(); break;
+			case 'M': derived().onANSIconf2(); break;
+			case 'N': derived().onANSIconf3(); break;
+			default:
+				// Undefined conformance.
+				break;
+		}
+		break;
+	case '#': // DEC specific adjustements
+		switch(param)
+		{
+			case '3': derived().onDECDHLth(); break;
+			case '4': derived().onDECDHLbh(); break;
+			case '5': derived().onDECSWL(); break;
+			case '6': derived().onDECDWL(); break;
+			case '8': derived().onDECALN(); break;
+			default:
+				break;
+		}
+		break;
+	case '%': // Character set
+		switch(param)
+		{
+			case '@': SetUTF8(false); derived().onISO8859_1(); break;
+			case 'G': SetUTF8(true); derived().onUTF_8(); break;
+			default:
+				break;
+		}
+		break;
+	case '(': // Designate G0 charset
+	    derived().onSCS(0, param);
+	    break;
+	case ')': // Designate G1 charset
+	case '-':
+	    derived().onSCS(1, param);
+	    break;
+	case '*': // Designate G2 charset
+	case '.':
+	    derived().onSCS(2, param);
+	    break;
+	case '+': // Designate G3 charset
+	case '/':
+	    derived().onSCS(3, param);
+	    break;
+	default:
+		// Invalid, TODO should I call onESC(...) with one char ? 
+		break;
+	}
+}
 
 
 #endif // _TERMINAL_PARSER_HPP_
-
@@ -0,0 +1,112 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * wxTerminal
+ * Copyright (C) 2013 Émilien KIA <emilien.kia@gmail.com>
+ * 
+wxTerminal is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * wxTerminal is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Check that the parser does not allocate memory once warmed up:
+ * parameters and intermediates are stored inline and passed as views,
+ * OSC strings reuse the capacity of their buffer.
+ */
+
+#include "terminal-parser.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+static size_t s_allocations = 0;
+
+void* operator new(size_t size)
+{
+	++s_allocations;
+	void* p = malloc(size ? size : 1);
+	if(p==NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+/**
+ * Parser receiving the sequences, checking some of their parameters.
+ */
+class TestParser : public TerminalParserT<TestParser>
+{
+	friend class TerminalParserT<TestParser>;
+public:
+	unsigned long sum = 0;
+	size_t sequences = 0;
+
+protected:
+	using TerminalParserT<TestParser>::onOSC;
+
+	void onPrintableText(TerminalParserText text){sum += text.size();}
+	void onCUP(unsigned short row, unsigned short col){sum += row + col; ++sequences;}
+	void onSGR(TerminalParserParams nbs){for(size_t n=0; n<nbs.size(); ++n) sum += nbs[n]; ++sequences;}
+	void onDECSET(TerminalParserParams nbs){sum += nbs[0]; ++sequences;}
+	void onEL(unsigned short nb){sum += nb; ++sequences;}
+	void onDECCRA(TerminalParserParams nbs){sum += nbs.size(); ++sequences;}
+	void onOSC(unsigned short command, const std::vector<unsigned char>& params){sum += command + params.size(); ++sequences;}
+};
+
+int main()
+{
+	// Typical output of full screen applications, plus a sequence with more parameters than stored.
+	std::string stream;
+	for(int n=0; n<100; ++n)
+	{
+		char seq[256];
+		snprintf(seq, sizeof(seq),
+			"\x1b[%d;%dH\x1b[1;38;2;%d;%d;%dm%s\x1b[0m\x1b[K\x1b[?25;1049h\x1b[1;1;5;5;1;10;10;1$v"
+			"\x1b]0;title %d\x07",
+			n % 25 + 1, n % 80 + 1, n, 255 - n, n * 2 % 256, "text", n);
+		stream += seq;
+	}
+	stream += "\x1b[1;2;3;4;5;6;7;8;9;10;11;12;13;14;15;16;17;18;19;20;21;22;23;24;25;26;27;28;29;30;31;32;33;34;35m";
+	stream += "\x1b[99999999;1H";
+
+	TestParser parser;
+	const unsigned char* data = (const unsigned char*)stream.data();
+
+	// Warm up: the OSC buffer reaches its capacity.
+	parser.Process(data, stream.size());
+
+	s_allocations = 0;
+	const int rounds = 1000;
+	for(int n=0; n<rounds; ++n)
+		parser.Process(data, stream.size());
+	size_t allocations = s_allocations;
+
+	printf("%zu sequences, %zu allocations\n", parser.sequences, allocations);
+	if(allocations!=0)
+	{
+		printf("FAIL: the parser allocated memory in steady state\n");
+		return 1;
+	}
+	return 0;
+}
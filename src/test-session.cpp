@@ -0,0 +1,252 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * wxTerminal
+ * Copyright (C) 2013 Émilien KIA <emilien.kia@gmail.com>
+ *
+wxTerminal is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wxTerminal is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Check that a screen saved to a session is restored identically, and that
+ * truncated or corrupted sessions are rejected instead of being trusted.
+ */
+
+#include <wx/wx.h>
+#include <wx/mstream.h>
+#include <wx/zstream.h>
+
+#include "terminal-ctrl.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static int s_failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if(!condition)
+	{
+		printf("FAIL: %s\n", what);
+		++s_failures;
+	}
+}
+
+static std::vector<unsigned char> getData(wxMemoryOutputStream& mem)
+{
+	std::vector<unsigned char> data(mem.GetSize());
+	if(!data.empty())
+		mem.CopyTo(&data[0], data.size());
+	return data;
+}
+
+/** Load a screen from the first bytes of a session, copied to be aligned as a mapped file. */
+static bool load(wxTerminalScreen& screen, const std::vector<unsigned char>& data, size_t size)
+{
+	std::vector<unsigned int> aligned(size / sizeof(unsigned int) + 1);
+	if(size>0)
+		memcpy(&aligned[0], &data[0], size);
+	wxTerminalSessionReader in((const unsigned char*)&aligned[0], size);
+	return screen.load(in);
+}
+
+/** Read all the lines and attributes, as painting does. */
+static size_t readAll(const wxTerminalScreen& screen)
+{
+	size_t sum = 0;
+	for(size_t n=screen.getHistoryFirstRow(); n<screen.getHistoryFirstRow()+screen.getHistoryRowCount(); ++n)
+	{
+		const wxTerminalLine& line = screen.getLineAbsolute(n);
+		for(size_t col=0; col<line.size(); ++col)
+			sum += line[col].c.GetValue() + screen.getAttributes(line[col]).fore;
+	}
+	return sum;
+}
+
+/** Compare the characters and attributes of two screens. */
+static bool same(const wxTerminalScreen& a, const wxTerminalScreen& b)
+{
+	if(a.getHistoryFirstRow()!=b.getHistoryFirstRow() || a.getHistoryRowCount()!=b.getHistoryRowCount()
+			|| a.getCaretAbsolutePosition()!=b.getCaretAbsolutePosition() || a.getScreenSize()!=b.getScreenSize())
+		return false;
+	for(size_t n=a.getHistoryFirstRow(); n<a.getHistoryFirstRow()+a.getHistoryRowCount(); ++n)
+	{
+		// Copied, the const accessors share a scratch line.
+		wxTerminalLine la = a.getLineAbsolute(n);
+		const wxTerminalLine& lb = b.getLineAbsolute(n);
+		if(la.size()!=lb.size())
+			return false;
+		for(size_t col=0; col<la.size(); ++col)
+			if(la[col].c!=lb[col].c || a.getAttributes(la[col])!=b.getAttributes(lb[col]))
+				return false;
+	}
+	return true;
+}
+
+/** Write the attribute table (entries all default) and screen values of a crafted session. */
+static void writeTail(wxTerminalSessionWriter& out, wxUint32 attributes)
+{
+	wxTerminalCharacterAttributes def = {7, 0, wxTCS_Invisible, wxTUS_Single, 0};
+	out.write<wxUint32>(attributes);
+	for(wxUint32 n=0; n<attributes; ++n)
+		out.write(def);
+	out.write<wxUint32>(0);
+	wxInt32 values[6] = {0, 0, 0, 0, 80, 25};
+	out.write(values);
+	out.align();
+}
+
+/** Craft a session of one frozen line, given as saved by wxTerminalFrozenLine::save(). */
+static std::vector<unsigned char> craftLine(const std::vector<unsigned int>& line, wxUint32 attributes = 1,
+	wxUint64 count = 1, wxUint64 max = 100)
+{
+	wxMemoryOutputStream mem;
+	wxTerminalSessionWriter out(mem);
+	out.write<wxUint64>(0);    // first
+	out.write<wxUint64>(count);
+	out.write<wxUint64>(max);
+	out.write<wxUint64>(1);    // active
+	out.write<wxUint64>(1024); // hot
+	out.write<wxInt32>(0);     // compression level
+	out.write<wxUint64>(0);    // blocks
+	out.write<wxUint64>(1);    // frozen lines
+	out.write(&line[0], line.size() * sizeof(unsigned int));
+	writeTail(out, attributes);
+	return getData(mem);
+}
+
+/** Craft a session of one compressed block of 'a' lines, announcing some number of words. */
+static std::vector<unsigned char> craftBlock(wxUint64 words, bool exact = false)
+{
+	std::vector<unsigned int> buffer;
+	for(size_t n=0; n<wxTerminalContent::BLOCK_LINES; ++n)
+	{
+		unsigned int line[] = {4, 1, 4, 0x61616161};
+		buffer.insert(buffer.end(), line, line + 4);
+	}
+	wxMemoryOutputStream compressed;
+	{
+		wxZlibOutputStream zlib(compressed, 1, wxZLIB_NO_HEADER);
+		zlib.Write(&buffer[0], buffer.size() * sizeof(unsigned int));
+		zlib.Close();
+	}
+	std::vector<unsigned char> data = getData(compressed);
+
+	wxMemoryOutputStream mem;
+	wxTerminalSessionWriter out(mem);
+	out.write<wxUint64>(0);
+	out.write<wxUint64>(wxTerminalContent::BLOCK_LINES);
+	out.write<wxUint64>(1000);
+	out.write<wxUint64>(1);
+	out.write<wxUint64>(1);
+	out.write<wxInt32>(1);
+	out.write<wxUint64>(1);
+	out.write<wxUint64>(0);    // block
+	out.write<wxUint64>(data.size());
+	out.write<wxUint64>(exact ? buffer.size() : words);
+	out.write(&data[0], data.size());
+	out.align();
+	out.write<wxUint64>(0);
+	writeTail(out, 1);
+	return getData(mem);
+}
+
+int main()
+{
+	// Lines of 8, 16 and 32-bit characters with many attributes, most of them compressed.
+	wxTerminalScreen screen;
+	screen.setHistoryMaxRowCount(5000);
+	screen.setHistoryCompression(1, 300);
+	for(int row=0; row<2000; ++row)
+	{
+		for(int col=0; col<=row%80; ++col)
+		{
+			wxTerminalCharacterAttributes attr = {(unsigned int)(row % 16), (unsigned int)(col % 8), wxTCS_Normal, wxTUS_Single, 0};
+			unsigned int c = row%3==0 ? 'a' + col%26 : row%3==1 ? 0x4E00 + col : 0x1F600 + col%16;
+			screen.setCharAbsolute(wxPoint(col, row), c, attr);
+		}
+	}
+	screen.setCaretAbsolutePosition(wxPoint(3, 1990));
+	wxTerminalMemoryStatistics stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	screen.addStatistics(stats);
+	check(stats.compressedLines>0, "lines are compressed before saving");
+
+	wxMemoryOutputStream mem;
+	wxTerminalSessionWriter out(mem);
+	screen.save(out);
+	check(out.isOk(), "the screen is saved");
+	std::vector<unsigned char> session = getData(mem);
+
+	wxTerminalScreen restored;
+	check(load(restored, session, session.size()), "the session is loaded");
+	check(same(screen, restored), "the restored screen is identical");
+
+	// Truncated sessions are rejected.
+	size_t accepted = 0;
+	for(size_t size=0; size<session.size(); size += size<4096 ? 1 : 61)
+	{
+		wxTerminalScreen truncated;
+		if(load(truncated, session, size))
+			++accepted;
+		readAll(truncated);
+	}
+	check(accepted==0, "truncated sessions are rejected");
+
+	// Random corruption is either rejected or gives a readable screen.
+	srand(1);
+	for(int round=0; round<500; ++round)
+	{
+		std::vector<unsigned char> corrupted = session;
+		for(int n=0; n<4; ++n)
+			corrupted[rand() % corrupted.size()] ^= 1 << (rand() % 8);
+		wxTerminalScreen screen;
+		load(screen, corrupted, corrupted.size());
+		readAll(screen);
+	}
+
+	// Frozen lines: runs must cover the line, with a known code point size and attribute.
+	wxTerminalScreen crafted;
+	std::vector<unsigned int> line = {10, 1, 10, 0x61616161, 0x61616161, 0x6161};
+	check(load(crafted, craftLine(line), craftLine(line).size()) && crafted.getLineAbsolute(0).size()==10, "a crafted line is loaded");
+	line[2] = 3;
+	check(!load(crafted, craftLine(line), craftLine(line).size()), "runs shorter than the line are rejected");
+	line[2] = 0xFFFF;
+	check(!load(crafted, craftLine(line), craftLine(line).size()), "runs longer than the line are rejected");
+	line[2] = (5 << 16) | 10;
+	check(!load(crafted, craftLine(line), craftLine(line).size()), "unknown attribute indexes are rejected");
+	check(load(crafted, craftLine(line, 6), craftLine(line, 6).size()), "known attribute indexes are accepted");
+	line = {2, 1 | (3u << 30), 2, 0x61, 0x61, 0x61, 0x61};
+	check(!load(crafted, craftLine(line), craftLine(line).size()), "unknown code point sizes are rejected");
+
+	// Sizes are bounded by limits and by the session size.
+	line = {10, 1, 10, 0x61616161, 0x61616161, 0x6161};
+	check(!load(crafted, craftLine(line, 1, (wxUint64)1 << 40, (wxUint64)1 << 40), craftLine(line).size()), "huge line counts are rejected");
+	std::vector<unsigned char> many = craftLine(line, 1, wxTerminalContent::MAX_SESSION_LINES, wxTerminalContent::MAX_SESSION_LINES);
+	check(!load(crafted, many, many.size()), "line counts beyond the session size are rejected");
+
+	// Compressed blocks: the number of words is bounded and must be available.
+	std::vector<unsigned char> block = craftBlock(0, true);
+	check(load(crafted, block, block.size()) && crafted.getLineAbsolute(255).size()==4, "a crafted block is loaded");
+	block = craftBlock((wxUint64)1 << 40);
+	check(!load(crafted, block, block.size()), "huge blocks are rejected");
+	block = craftBlock(wxTerminalContent::MAX_BLOCK_WORDS + 1);
+	check(!load(crafted, block, block.size()), "blocks beyond the longest lines are rejected");
+	block = craftBlock(wxTerminalContent::BLOCK_LINES * 4 + 100);
+	check(load(crafted, block, block.size()) && crafted.getLineAbsolute(0).empty(), "blocks shorter than announced are not used");
+
+	if(s_failures==0)
+		printf("session of %zu bytes checked\n", session.size());
+	return s_failures==0 ? 0 : 1;
+}
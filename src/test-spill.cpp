@@ -0,0 +1,129 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*-  */
+/*
+ * wxTerminal
+ * Copyright (C) 2013 Émilien KIA <emilien.kia@gmail.com>
+ *
+wxTerminal is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wxTerminal is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Check the spill file against a model: a stored block always reads back
+ * the bytes it was appended with, even after the file wrapped, and the
+ * last appended block is always stored.
+ */
+
+#include <wx/wx.h>
+#include <wx/filename.h>
+
+#include "terminal-ctrl.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/** Content of a block, distinct for each block number. */
+static std::vector<unsigned char> blockData(size_t block, size_t size)
+{
+	std::vector<unsigned char> data(size);
+	for(size_t n=0; n<size; ++n)
+		data[n] = (unsigned char)(block * 31 + n);
+	return data;
+}
+
+/**
+ * Append a block and check all the blocks still stored.
+ * Return false on the first inconsistency.
+ */
+static bool append(wxTerminalSpillFile& file, std::vector<size_t>& sizes, size_t block, size_t size, size_t maxBytes)
+{
+	std::vector<unsigned char> data = blockData(block, size);
+	file.append(block, data.data(), size, block);
+	if(sizes.size()<=block)
+		sizes.resize(block+1, 0);
+	sizes[block] = size;
+
+	size_t dataSize = 0, words = 0;
+	if(file.get(block, dataSize, words)==NULL)
+	{
+		printf("FAIL: block %zu of %zu bytes is not stored\n", block, size);
+		return false;
+	}
+
+	for(size_t n=file.getFirstBlock(); n<file.getEndBlock(); ++n)
+	{
+		const unsigned char* stored = file.get(n, dataSize, words);
+		if(stored==NULL)
+			continue;
+		std::vector<unsigned char> expected = blockData(n, sizes[n]);
+		if(dataSize!=sizes[n] || words!=n || !std::equal(expected.begin(), expected.end(), stored))
+		{
+			printf("FAIL: block %zu is overwritten after appending block %zu\n", n, block);
+			return false;
+		}
+	}
+	if(file.getUsedBytes()>maxBytes)
+	{
+		printf("FAIL: %zu bytes used in a file of %zu\n", file.getUsedBytes(), maxBytes);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	wxTerminalSpillFile file;
+	if(!file.open("test-spill.bin", 100))
+	{
+		printf("SKIP: spill files are not supported\n");
+		return 77;
+	}
+
+	// Wrapping twice: the tail block left after the first wrap is dropped
+	// before the blocks at the start of the file are overwritten.
+	std::vector<size_t> sizes;
+	if(!append(file, sizes, 0, 90, 100) || !append(file, sizes, 1, 10, 100)
+		|| !append(file, sizes, 2, 75, 100) || !append(file, sizes, 3, 30, 100))
+		return 1;
+
+	// Random sizes, with skipped blocks.
+	srand(1);
+	for(int round=0; round<20; ++round)
+	{
+		size_t maxBytes = 100 + rand() % 4000;
+		if(!file.open("test-spill.bin", maxBytes))
+		{
+			printf("FAIL: cannot open the spill file\n");
+			return 1;
+		}
+		sizes.clear();
+		size_t block = 0;
+		for(int n=0; n<2000; ++n)
+		{
+			block += rand() % 10 ? 1 : 1 + rand() % 3;
+			size_t size = 1 + rand() % (rand() % 4 ? maxBytes / 8 : maxBytes);
+			if(!append(file, sizes, block, size, maxBytes))
+				return 1;
+		}
+	}
+	file.close();
+
+	if(wxFileExists("test-spill.bin"))
+	{
+		printf("FAIL: the spill file is not removed\n");
+		return 1;
+	}
+	printf("spill file checked\n");
+	return 0;
+}